@@ -1,5 +1,5 @@
 QMAKE_CXXFLAGS += -std=c++0x -pthread
-LIBS += -pthread
+LIBS += -pthread -lrt
 
 CONFIG -= qt -Wl,--no-as-needed
 
@@ -21,6 +21,8 @@ SOURCES += \
     search.cpp \
     evaluation.cpp \
     transpositiontable.cpp \
+    pawntable.cpp \
+    materialtable.cpp \
     zobrist.cpp \
     hashentry.cpp \
     uci.cpp \
@@ -50,9 +52,12 @@ HEADERS += \
     search.h \
     evaluation.h \
     transpositiontable.h \
+    pawntable.h \
+    materialtable.h \
     zobrist.h \
     hashentry.h \
     uci.h \
     searchinfo.h \
+    splitpoint.h \
     moveselector.h \
     piecesquaretables.h
@@ -56,7 +56,7 @@ namespace Napoleon
             if(move.ToSan(board) == epd.BestMove)
                 correct++;
 
-            nodesVisited += Search::searchInfo.Nodes();
+            nodesVisited += Search::NodeCount();
         }
 
 
@@ -16,6 +16,34 @@
 
 namespace Napoleon
 {
+    StateStack::StateStack() : entries(new StateInfo[Constants::MaxPly])
+    {
+        Clear();
+    }
+
+    StateStack::StateStack(const StateStack& stack) : entries(new StateInfo[Constants::MaxPly])
+    {
+        *this = stack;
+    }
+
+    // keeps the entries of this stack, copying only the ones since the last irreversible move
+    StateStack& StateStack::operator=(const StateStack& stack)
+    {
+        if (this != &stack)
+        {
+            first = std::max(stack.first, stack.live);
+            ply = stack.ply;
+            live = stack.live;
+            std::copy(&stack.entries[first - stack.first], &stack.entries[ply - stack.first], &entries[0]);
+        }
+        return *this;
+    }
+
+    void StateStack::Clear()
+    {
+        first = ply = live = 0;
+    }
+
     Board::Board()
     {
         MoveDatabase::InitAttacks();
@@ -48,9 +76,10 @@ namespace Napoleon
         material[PieceColor::White] = 0;
         material[PieceColor::Black] = 0;
         allowNullMove = true;
-        currentPly = 0;
+        states.Clear();
         zobrist = 0;
         pawnKey = 0;
+        materialKey = 0;
         initializeCastlingStatus(fenString);
         initializesideToMove(fenString);
         initializePieceSet(fenString);
@@ -90,7 +119,7 @@ namespace Napoleon
 
         if (piece.Type != PieceType::None)
         {
-            numOfPieces[piece.Color][piece.Type]++;
+            materialKey ^= Zobrist::Piece[piece.Color][piece.Type][numOfPieces[piece.Color][piece.Type]++];
             material[piece.Color] += Constants::Piece::PieceValue[piece.Type];
             zobrist ^= Zobrist::Piece[piece.Color][piece.Type][sq];
 
@@ -186,7 +215,7 @@ namespace Napoleon
         std::cout << (castlingStatus & Constants::Castle::BlackCastleOO ? "k" : "");
         std::cout << (castlingStatus & Constants::Castle::BlackCastleOOO ? "q" : "") << std::endl;
         std::cout << "HalfMove Clock: " << halfMoveClock << std::endl;
-        std::cout << "Ply: " << currentPly << std::endl;
+        std::cout << "Ply: " << CurrentPly() << std::endl;
         std::cout << "Game Phase: " << Phase() << std::endl;
         //        std::cout << "pstValue[white]: " << pstValue[PieceColor::White] << "\t calculated: " << CalculatePST(PieceColor::White) << std::endl;
         //        std::cout << "pstValue[black]: " << pstValue[PieceColor::Black] << "\t calculated: " << CalculatePST(PieceColor::Black) << std::endl;
@@ -315,6 +344,30 @@ namespace Napoleon
 
     void Board::MakeMove(Move move)
     {
+        if (sideToMove == PieceColor::White)
+            makeMove<PieceColor::White>(move);
+        else
+            makeMove<PieceColor::Black>(move);
+    }
+
+    // the moving side is a template parameter, so that castling squares and rights
+    // and the en passant direction are compile time constants
+    template<Color us>
+    void Board::makeMove(Move move)
+    {
+        using namespace Constants::Castle;
+
+        const Color them = us == PieceColor::White ? PieceColor::Black : PieceColor::White;
+        const int pawnBehind = us == PieceColor::White ? -8 : 8; // from the en passant square to the captured pawn
+        const Byte rightsOO = us == PieceColor::White ? WhiteCastleOO : BlackCastleOO;
+        const Byte rightsOOO = us == PieceColor::White ? WhiteCastleOOO : BlackCastleOOO;
+        const Byte enemyRightsOO = us == PieceColor::White ? BlackCastleOO : WhiteCastleOO;
+        const Byte enemyRightsOOO = us == PieceColor::White ? BlackCastleOOO : WhiteCastleOOO;
+        const Napoleon::Square rookOO = us == PieceColor::White ? Constants::Squares::IntH1 : Constants::Squares::IntH8;
+        const Napoleon::Square rookOOO = us == PieceColor::White ? Constants::Squares::IntA1 : Constants::Squares::IntA8;
+        const Napoleon::Square enemyRookOO = us == PieceColor::White ? Constants::Squares::IntH8 : Constants::Squares::IntH1;
+        const Napoleon::Square enemyRookOOO = us == PieceColor::White ? Constants::Squares::IntA8 : Constants::Squares::IntA1;
+
         bool incrementClock = true;
 
         Square from = move.FromSquare();
@@ -322,15 +375,11 @@ namespace Napoleon
         Type promoted;
         Type captured = move.IsEnPassant() ? static_cast<Type>(PieceType::Pawn) : pieceSet[to].Type;
         Type pieceMoved = pieceSet[from].Type;
-        Color enemy = Utils::Piece::GetOpposite(sideToMove);
 
         bool capture = captured != PieceType::None;
 
-        castlingStatusHistory[currentPly] = castlingStatus;  // salva i diritti di arrocco correnti
-        enpSquaresHistory[currentPly] = enPassantSquare; // salva l'attuale casella enpassant
-        halfMoveClockHistory[currentPly] = halfMoveClock; // salva l'attuale contatore di semi-mosse
-        hashHistory[currentPly] = zobrist; // salva l'hash key per verificare se la posizione si e` ripetuta
-        capturedPieceHistory[currentPly] = captured; // salva il pezzo catturato
+        // salva lo stato corrente
+        states.Push({ zobrist, halfMoveClock, castlingStatus, static_cast<Byte>(enPassantSquare), captured, 0 });
 
         zobrist ^= Zobrist::Color; // aggiorna il colore della posizione
 
@@ -338,8 +387,8 @@ namespace Napoleon
         pieceSet[to] = pieceSet[from]; // muove il pezzo
         pieceSet[from] = Constants::Piece::Null; // svuota la casella di partenza
 
-        updatePstvalue<Sub>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, pieceMoved), from));
-        updatePstvalue<Add>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, pieceMoved), to));
+        updatePstvalue<Sub>(us, Evaluation::PieceSquareValue(Piece(us, pieceMoved), from));
+        updatePstvalue<Add>(us, Evaluation::PieceSquareValue(Piece(us, pieceMoved), to));
 
         //BITBOARDS
         BitBoard From = Constants::Masks::SquareMask[from];
@@ -347,148 +396,114 @@ namespace Napoleon
         BitBoard FromTo = From | To;
 
         // aggiorna la bitboard
-        bitBoardSet[sideToMove][pieceMoved] ^= FromTo;
-        zobrist ^= Zobrist::Piece[sideToMove][pieceMoved][from]; // aggiorna zobrist key (rimuove il pezzo mosso)
-        zobrist ^= Zobrist::Piece[sideToMove][pieceMoved][to]; // aggiorna zobrist key (sposta il pezzo mosso)
+        bitBoardSet[us][pieceMoved] ^= FromTo;
+        zobrist ^= Zobrist::Piece[us][pieceMoved][from]; // aggiorna zobrist key (rimuove il pezzo mosso)
+        zobrist ^= Zobrist::Piece[us][pieceMoved][to]; // aggiorna zobrist key (sposta il pezzo mosso)
 
         if (pieceMoved == PieceType::Pawn /*|| pieceMoved == PieceType::King*/)
         {
-            pawnKey ^= Zobrist::Piece[sideToMove][pieceMoved][from]; 
-            pawnKey ^= Zobrist::Piece[sideToMove][pieceMoved][to]; 
+            pawnKey ^= Zobrist::Piece[us][pieceMoved][from]; 
+            pawnKey ^= Zobrist::Piece[us][pieceMoved][to]; 
         }
 
         // aggiorna i pezzi del giocatore
-        pieces[sideToMove] ^= FromTo;
+        pieces[us] ^= FromTo;
 
         // se ilpezzo mosso e` il re si aggiorna la sua casella
         if (pieceMoved == PieceType::King)
         {
-            kingSquare[sideToMove] = to;
+            kingSquare[us] = to;
 
             if (move.IsCastle())
             {
-                makeCastle(from, to);
+                makeCastle<us>(from, to);
             }
 
-            if (sideToMove == PieceColor::White)
-                castlingStatus &= ~(Constants::Castle::WhiteCastleOO | Constants::Castle::WhiteCastleOOO); // azzera i diritti di arrocco per il bianco
-            else
-                castlingStatus &= ~(Constants::Castle::BlackCastleOO | Constants::Castle::BlackCastleOOO); // azzera i diritti di arrocco per il nero
+            castlingStatus &= ~(rightsOO | rightsOOO); // azzera i diritti di arrocco del giocatore
         }
         else if (pieceMoved == PieceType::Rook) // se e` stata mossa una torre cambia i diritti di arrocco
         {
             if (castlingStatus) // se i giocatori possono ancora muovere
             {
-                if (sideToMove == PieceColor::White)
-                {
-                    if (from == Constants::Squares::IntA1)
-                        castlingStatus &= ~Constants::Castle::WhiteCastleOOO;
-                    else if (from == Constants::Squares::IntH1)
-                        castlingStatus &= ~Constants::Castle::WhiteCastleOO;
-                }
-                else
-                {
-                    if (from == Constants::Squares::IntA8)
-                        castlingStatus &= ~Constants::Castle::BlackCastleOOO;
-                    else if (from == Constants::Squares::IntH8)
-                        castlingStatus &= ~Constants::Castle::BlackCastleOO;
-                }
+                if (from == rookOOO)
+                    castlingStatus &= ~rightsOOO;
+                else if (from == rookOO)
+                    castlingStatus &= ~rightsOO;
             }
         }
         else if (move.IsPromotion())
         {
             promoted = move.PiecePromoted();
-            pieceSet[to] = Piece(sideToMove, promoted);
-            bitBoardSet[sideToMove][PieceType::Pawn] ^= To;
-            bitBoardSet[sideToMove][promoted] ^= To;
-            numOfPieces[sideToMove][PieceType::Pawn]--;
-            numOfPieces[sideToMove][promoted]++;
-
-            material[sideToMove] -= Constants::Piece::PieceValue[PieceType::Pawn];
-            material[sideToMove] += Constants::Piece::PieceValue[promoted];
-            zobrist ^= Zobrist::Piece[sideToMove][PieceType::Pawn][to];
-            zobrist ^= Zobrist::Piece[sideToMove][promoted][to];
-            pawnKey ^= Zobrist::Piece[sideToMove][PieceType::Pawn][to];
-            updatePstvalue<Sub>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, PieceType::Pawn), to));
-            updatePstvalue<Add>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, promoted), to));
+            pieceSet[to] = Piece(us, promoted);
+            bitBoardSet[us][PieceType::Pawn] ^= To;
+            bitBoardSet[us][promoted] ^= To;
+            materialKey ^= Zobrist::Piece[us][PieceType::Pawn][--numOfPieces[us][PieceType::Pawn]];
+            materialKey ^= Zobrist::Piece[us][promoted][numOfPieces[us][promoted]++];
+
+            material[us] -= Constants::Piece::PieceValue[PieceType::Pawn];
+            material[us] += Constants::Piece::PieceValue[promoted];
+            zobrist ^= Zobrist::Piece[us][PieceType::Pawn][to];
+            zobrist ^= Zobrist::Piece[us][promoted][to];
+            pawnKey ^= Zobrist::Piece[us][PieceType::Pawn][to];
+            updatePstvalue<Sub>(us, Evaluation::PieceSquareValue(Piece(us, PieceType::Pawn), to));
+            updatePstvalue<Add>(us, Evaluation::PieceSquareValue(Piece(us, promoted), to));
 
             if (!capture)
-                pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(from)]--;
+                pawnsOnFile[us][Utils::Square::GetFileIndex(from)]--;
             else
-                pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(to)]--;
+                pawnsOnFile[us][Utils::Square::GetFileIndex(to)]--;
         }
         if (capture)
         {
             if (move.IsEnPassant())
             {
-                BitBoard piece;
-                if (sideToMove == PieceColor::White)
-                {
-                    piece = Constants::Masks::SquareMask[enPassantSquare - 8];
-                    pieceSet[enPassantSquare - 8] = Constants::Piece::Null;
-                    updatePstvalue<Sub>(enemy, Evaluation::PieceSquareValue(Piece(enemy, PieceType::Pawn), enPassantSquare - 8));
-                    zobrist ^= Zobrist::Piece[enemy][PieceType::Pawn][enPassantSquare - 8]; // rimuove il pedone nero catturato en passant
-                    pawnKey ^= Zobrist::Piece[enemy][PieceType::Pawn][enPassantSquare - 8]; // rimuove il pedone nero catturato en passant
-                }
-                else
-                {
-                    piece = Constants::Masks::SquareMask[enPassantSquare + 8];
-                    pieceSet[enPassantSquare + 8] = Constants::Piece::Null;
-                    updatePstvalue<Sub>(enemy, Evaluation::PieceSquareValue(Piece(enemy, PieceType::Pawn), enPassantSquare + 8));
-                    zobrist ^= Zobrist::Piece[enemy][PieceType::Pawn][enPassantSquare + 8]; // rimuove il pedone bianco catturato en passant
-                    pawnKey ^= Zobrist::Piece[enemy][PieceType::Pawn][enPassantSquare + 8]; // rimuove il pedone bianco catturato en passant
-                }
-
-                pieces[enemy] ^= piece;
-                bitBoardSet[enemy][PieceType::Pawn] ^= piece;
+                Square capturedSquare = enPassantSquare + pawnBehind;
+                BitBoard piece = Constants::Masks::SquareMask[capturedSquare];
+                pieceSet[capturedSquare] = Constants::Piece::Null;
+                updatePstvalue<Sub>(them, Evaluation::PieceSquareValue(Piece(them, PieceType::Pawn), capturedSquare));
+                zobrist ^= Zobrist::Piece[them][PieceType::Pawn][capturedSquare]; // rimuove il pedone catturato en passant
+                pawnKey ^= Zobrist::Piece[them][PieceType::Pawn][capturedSquare]; // rimuove il pedone catturato en passant
+
+                pieces[them] ^= piece;
+                bitBoardSet[them][PieceType::Pawn] ^= piece;
                 OccupiedSquares ^= FromTo ^ piece;
                 EmptySquares ^= FromTo ^ piece;
 
-                pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(from)]--;
-                pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(to)]++;
-                pawnsOnFile[enemy][Utils::Square::GetFileIndex(to)]--;
+                pawnsOnFile[us][Utils::Square::GetFileIndex(from)]--;
+                pawnsOnFile[us][Utils::Square::GetFileIndex(to)]++;
+                pawnsOnFile[them][Utils::Square::GetFileIndex(to)]--;
             }
             else
             {
                 if (captured == PieceType::Rook)
                 {
-                    if (enemy == PieceColor::White)
-                    {
-                        if (to == Constants::Squares::IntH1)
-                            castlingStatus &= ~Constants::Castle::WhiteCastleOO;
-                        else if (to == Constants::Squares::IntA1)
-                            castlingStatus &= ~Constants::Castle::WhiteCastleOOO;
-                    }
-                    else
-                    {
-                        if (to == Constants::Squares::IntH8)
-                            castlingStatus &= ~Constants::Castle::BlackCastleOO;
-                        else if (to == Constants::Squares::IntA8)
-                            castlingStatus &= ~Constants::Castle::BlackCastleOOO;
-                    }
+                    if (to == enemyRookOO)
+                        castlingStatus &= ~enemyRightsOO;
+                    else if (to == enemyRookOOO)
+                        castlingStatus &= ~enemyRightsOOO;
                 }
                 else if (captured == PieceType::Pawn)
                 {
-                    pawnsOnFile[enemy][Utils::Square::GetFileIndex(to)]--;
-                    pawnKey ^= Zobrist::Piece[enemy][PieceType::Pawn][to];
+                    pawnsOnFile[them][Utils::Square::GetFileIndex(to)]--;
+                    pawnKey ^= Zobrist::Piece[them][PieceType::Pawn][to];
                 }
 
                 if (pieceMoved == PieceType::Pawn)
                 {
-                    pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(from)]--;
-                    pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(to)]++;
+                    pawnsOnFile[us][Utils::Square::GetFileIndex(from)]--;
+                    pawnsOnFile[us][Utils::Square::GetFileIndex(to)]++;
                 }
 
-                updatePstvalue<Sub>(enemy, Evaluation::PieceSquareValue(Piece(enemy, captured), to));
-                bitBoardSet[enemy][captured] ^= To;
-                pieces[enemy] ^= To; //aggiorna i pezzi dell'avversario
+                updatePstvalue<Sub>(them, Evaluation::PieceSquareValue(Piece(them, captured), to));
+                bitBoardSet[them][captured] ^= To;
+                pieces[them] ^= To; //aggiorna i pezzi dell'avversario
                 OccupiedSquares ^= From;
                 EmptySquares ^= From;
-                zobrist ^= Zobrist::Piece[enemy][captured][to]; // rimuove il pezzo catturato
+                zobrist ^= Zobrist::Piece[them][captured][to]; // rimuove il pezzo catturato
             }
 
-            numOfPieces[enemy][captured]--;
-            material[enemy] -= Constants::Piece::PieceValue[captured];
+            materialKey ^= Zobrist::Piece[them][captured][--numOfPieces[them][captured]];
+            material[them] -= Constants::Piece::PieceValue[captured];
             incrementClock = false; // non incrementare il contatore di semi-mosse perche` e` stato catturato un pezzo
         }
         else
@@ -520,41 +535,53 @@ namespace Napoleon
             }
         }
 
-        if (castlingStatusHistory[currentPly] != castlingStatus)
+        if (states.Top().castlingStatus != castlingStatus)
             zobrist ^= Zobrist::Castling[castlingStatus]; // cambia i diritti di arrocco
 
         if (incrementClock) halfMoveClock++; // incrementa il contatore
-        else halfMoveClock = 0; // resetta il contatore
+        else
+        {
+            halfMoveClock = 0; // resetta il contatore
+            states.Irreversible();
+        }
 
         // cambia turno
-        sideToMove = enemy;
-
-        // aumenta profondita`
-        currentPly++;
+        sideToMove = them;
 
         ASSERT(PosIsOk());
     }
 
     void Board::UndoMove(Move move)
     {
+        if (sideToMove == PieceColor::Black)
+            undoMove<PieceColor::White>(move);
+        else
+            undoMove<PieceColor::Black>(move);
+    }
+
+    template<Color us>
+    void Board::undoMove(Move move)
+    {
+        const Color them = us == PieceColor::White ? PieceColor::Black : PieceColor::White;
+        const int pawnBehind = us == PieceColor::White ? -8 : 8; // from the en passant square to the captured pawn
+
         Square from = move.FromSquare();
         Square to = move.ToSquare();
-        Color enemy = sideToMove;
         bool promotion = move.IsPromotion();
         bool capture;
         Type promoted;
         Type captured;
         Type pieceMoved;
 
-        // decrementa profondita`
-        currentPly--;
+        // ripristina lo stato precedente
+        const StateInfo& previous = states.Pop();
 
-        captured = capturedPieceHistory[currentPly];
+        captured = previous.capturedPiece;
         capture = captured != PieceType::None;
 
         zobrist ^= Zobrist::Color; // aggiorna il colore della posizione
 
-        if (castlingStatusHistory[currentPly] != castlingStatus)
+        if (previous.castlingStatus != castlingStatus)
             zobrist ^= Zobrist::Castling[castlingStatus]; // cambia i diritti di arrocco
 
         if (enPassantSquare != Constants::Squares::Invalid)
@@ -563,13 +590,13 @@ namespace Napoleon
             pawnKey ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enPassantSquare)];
         }
 
-        if (enpSquaresHistory[currentPly] != Constants::Squares::Invalid)
+        if (previous.enPassantSquare != Constants::Squares::Invalid)
         {
-            zobrist ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enpSquaresHistory[currentPly])];
-            pawnKey ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enpSquaresHistory[currentPly])];
+            zobrist ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(previous.enPassantSquare)];
+            pawnKey ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(previous.enPassantSquare)];
         }
 
-        halfMoveClock = halfMoveClockHistory[currentPly];
+        halfMoveClock = previous.halfMoveClock;
 
         // se la mossa e` stata una promozione il pezzo mosso e` un pedone
         if (promotion)
@@ -578,15 +605,15 @@ namespace Napoleon
             pieceMoved = pieceSet[to].Type;
 
         // reimposta il turno
-        sideToMove = Utils::Piece::GetOpposite(sideToMove);
+        sideToMove = us;
 
         // ARRAY
         pieceSet[from] = pieceSet[to]; // muove il pezzo
 
         if (!promotion)
         {
-           updatePstvalue<Sub>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, pieceMoved), to));
-           updatePstvalue<Add>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, pieceMoved), from));
+           updatePstvalue<Sub>(us, Evaluation::PieceSquareValue(Piece(us, pieceMoved), to));
+           updatePstvalue<Add>(us, Evaluation::PieceSquareValue(Piece(us, pieceMoved), from));
         }
 
         // BITBOARDS
@@ -595,129 +622,117 @@ namespace Napoleon
         BitBoard FromTo = From | To;
 
         // aggiorna la bitboard
-        bitBoardSet[sideToMove][pieceMoved] ^= FromTo;
-        zobrist ^= Zobrist::Piece[sideToMove][pieceMoved][from]; // aggiorna zobrist key (rimuove il pezzo mosso)
-        zobrist ^= Zobrist::Piece[sideToMove][pieceMoved][to]; // aggiorna zobrist key (sposta il pezzo mosso)
+        bitBoardSet[us][pieceMoved] ^= FromTo;
+        zobrist ^= Zobrist::Piece[us][pieceMoved][from]; // aggiorna zobrist key (rimuove il pezzo mosso)
+        zobrist ^= Zobrist::Piece[us][pieceMoved][to]; // aggiorna zobrist key (sposta il pezzo mosso)
 
         if (pieceMoved == PieceType::Pawn /*|| pieceMoved == PieceType::King*/)
         {
-            pawnKey ^= Zobrist::Piece[sideToMove][pieceMoved][from]; 
-            pawnKey ^= Zobrist::Piece[sideToMove][pieceMoved][to]; 
+            pawnKey ^= Zobrist::Piece[us][pieceMoved][from]; 
+            pawnKey ^= Zobrist::Piece[us][pieceMoved][to]; 
         }
 
         // aggiorna i pezzi del giocatore
-        pieces[sideToMove] ^= FromTo;
+        pieces[us] ^= FromTo;
 
         // se ilpezzo mosso e` il re si aggiorna la sua casella
         if (pieceMoved == PieceType::King)
         {
-            kingSquare[sideToMove] = from;
+            kingSquare[us] = from;
 
             if (move.IsCastle())
             {
-                undoCastle(from, to);
+                undoCastle<us>(from, to);
             }
 
-            castlingStatus = castlingStatusHistory[currentPly]; // resetta i diritti di arrocco dello stato precedente
+            castlingStatus = previous.castlingStatus; // resetta i diritti di arrocco dello stato precedente
         }
         else if (pieceMoved == PieceType::Rook)
         {
-            castlingStatus = castlingStatusHistory[currentPly];
+            castlingStatus = previous.castlingStatus;
         }
         else if (promotion)
         {
             promoted = move.PiecePromoted();
-            numOfPieces[sideToMove][PieceType::Pawn]++;
-            numOfPieces[sideToMove][promoted]--;
-
-            material[sideToMove] += Constants::Piece::PieceValue[PieceType::Pawn];
-            material[sideToMove] -= Constants::Piece::PieceValue[promoted];
-            pieceSet[from] = Piece(sideToMove, PieceType::Pawn);
-            bitBoardSet[sideToMove][promoted] ^= To;
-            bitBoardSet[sideToMove][PieceType::Pawn] ^= To;
-            zobrist ^= Zobrist::Piece[sideToMove][PieceType::Pawn][to];
-            zobrist ^= Zobrist::Piece[sideToMove][promoted][to];
-            pawnKey ^= Zobrist::Piece[sideToMove][PieceType::Pawn][to];
-            updatePstvalue<Add>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, PieceType::Pawn), from));
-            updatePstvalue<Sub>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, promoted), to));
+            materialKey ^= Zobrist::Piece[us][PieceType::Pawn][numOfPieces[us][PieceType::Pawn]++];
+            materialKey ^= Zobrist::Piece[us][promoted][--numOfPieces[us][promoted]];
+
+            material[us] += Constants::Piece::PieceValue[PieceType::Pawn];
+            material[us] -= Constants::Piece::PieceValue[promoted];
+            pieceSet[from] = Piece(us, PieceType::Pawn);
+            bitBoardSet[us][promoted] ^= To;
+            bitBoardSet[us][PieceType::Pawn] ^= To;
+            zobrist ^= Zobrist::Piece[us][PieceType::Pawn][to];
+            zobrist ^= Zobrist::Piece[us][promoted][to];
+            pawnKey ^= Zobrist::Piece[us][PieceType::Pawn][to];
+            updatePstvalue<Add>(us, Evaluation::PieceSquareValue(Piece(us, PieceType::Pawn), from));
+            updatePstvalue<Sub>(us, Evaluation::PieceSquareValue(Piece(us, promoted), to));
 
             if (!capture)
-                pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(from)]++;
+                pawnsOnFile[us][Utils::Square::GetFileIndex(from)]++;
             else
-                pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(to)]++;
+                pawnsOnFile[us][Utils::Square::GetFileIndex(to)]++;
         }
 
         // reimposta la casella enpassant
-        enPassantSquare = enpSquaresHistory[currentPly];
+        enPassantSquare = previous.enPassantSquare;
 
         if (capture)
         {
             if (move.IsEnPassant())
             {
                 pieceSet[to] = Constants::Piece::Null; // svuota la casella di partenza perche` non c'erano pezzi prima
-                BitBoard piece;
-
-                if (sideToMove == PieceColor::White)
-                {
-                    piece = Constants::Masks::SquareMask[enPassantSquare - 8];
-                    pieceSet[enPassantSquare - 8] = Piece(PieceColor::Black, PieceType::Pawn);
-                    updatePstvalue<Add>(enemy, Evaluation::PieceSquareValue(Piece(enemy, PieceType::Pawn), enPassantSquare - 8));
-                    zobrist ^= Zobrist::Piece[enemy][PieceType::Pawn][enPassantSquare - 8]; // rimuove il pedone nero catturato en passant
-                    pawnKey ^= Zobrist::Piece[enemy][PieceType::Pawn][enPassantSquare - 8]; // rimuove il pedone nero catturato en passant
-                }
-                else
-                {
-                    piece = Constants::Masks::SquareMask[enPassantSquare + 8];
-                    pieceSet[enPassantSquare + 8] = Piece(PieceColor::White, PieceType::Pawn);
-                    updatePstvalue<Add>(enemy, Evaluation::PieceSquareValue(Piece(enemy, PieceType::Pawn), enPassantSquare + 8));
-                    zobrist ^= Zobrist::Piece[enemy][PieceType::Pawn][enPassantSquare + 8]; // rimuove il pedone nero catturato en passant
-                    pawnKey ^= Zobrist::Piece[enemy][PieceType::Pawn][enPassantSquare + 8]; // rimuove il pedone nero catturato en passant
-                }
-
-                pieces[enemy] ^= piece;
-                bitBoardSet[enemy][PieceType::Pawn] ^= piece;
+                Square capturedSquare = enPassantSquare + pawnBehind;
+                BitBoard piece = Constants::Masks::SquareMask[capturedSquare];
+                pieceSet[capturedSquare] = Piece(them, PieceType::Pawn);
+                updatePstvalue<Add>(them, Evaluation::PieceSquareValue(Piece(them, PieceType::Pawn), capturedSquare));
+                zobrist ^= Zobrist::Piece[them][PieceType::Pawn][capturedSquare]; // rimette il pedone catturato en passant
+                pawnKey ^= Zobrist::Piece[them][PieceType::Pawn][capturedSquare]; // rimette il pedone catturato en passant
+
+                pieces[them] ^= piece;
+                bitBoardSet[them][PieceType::Pawn] ^= piece;
                 OccupiedSquares ^= FromTo ^ piece;
                 EmptySquares ^= FromTo ^ piece;
 
-                pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(from)]++;
-                pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(to)]--;
-                pawnsOnFile[enemy][Utils::Square::GetFileIndex(to)]++;
+                pawnsOnFile[us][Utils::Square::GetFileIndex(from)]++;
+                pawnsOnFile[us][Utils::Square::GetFileIndex(to)]--;
+                pawnsOnFile[them][Utils::Square::GetFileIndex(to)]++;
             }
             else
             {
                 assert(captured != PieceType::None);
-                assert(captured == capturedPieceHistory[currentPly]);
+                assert(captured == previous.capturedPiece);
 
                 if (captured == PieceType::Rook)
                 {
-                    castlingStatus = castlingStatusHistory[currentPly];
+                    castlingStatus = previous.castlingStatus;
                 }
                 else if (captured == PieceType::Pawn)
                 {
-                    pawnsOnFile[enemy][Utils::Square::GetFileIndex(to)]++;
-                    pawnKey ^= Zobrist::Piece[enemy][PieceType::Pawn][to];
+                    pawnsOnFile[them][Utils::Square::GetFileIndex(to)]++;
+                    pawnKey ^= Zobrist::Piece[them][PieceType::Pawn][to];
                 }
                 if (pieceMoved == PieceType::Pawn)
                 {
-                    pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(from)]++;
-                    pawnsOnFile[sideToMove][Utils::Square::GetFileIndex(to)]--;
+                    pawnsOnFile[us][Utils::Square::GetFileIndex(from)]++;
+                    pawnsOnFile[us][Utils::Square::GetFileIndex(to)]--;
                 }
 
-                updatePstvalue<Add>(enemy, Evaluation::PieceSquareValue(Piece(enemy, captured), to));
+                updatePstvalue<Add>(them, Evaluation::PieceSquareValue(Piece(them, captured), to));
 
                 // reinserisce il pezzo catturato nella sua casella
-                pieceSet[to] = Piece(enemy, captured);
-                bitBoardSet[enemy][captured] ^= To;
+                pieceSet[to] = Piece(them, captured);
+                bitBoardSet[them][captured] ^= To;
 
-                pieces[enemy] ^= To; //aggiorna i pezzi dell'avversario
+                pieces[them] ^= To; //aggiorna i pezzi dell'avversario
                 OccupiedSquares ^= From;
                 EmptySquares ^= From;
 
-                zobrist ^= Zobrist::Piece[enemy][captured][to]; // rimuove il pezzo catturato
+                zobrist ^= Zobrist::Piece[them][captured][to]; // rimuove il pezzo catturato
             }
 
-            numOfPieces[enemy][captured]++;
-            material[enemy] += Constants::Piece::PieceValue[captured];
+            materialKey ^= Zobrist::Piece[them][captured][numOfPieces[them][captured]++];
+            material[them] += Constants::Piece::PieceValue[captured];
 
         }
         else
@@ -731,6 +746,7 @@ namespace Napoleon
         ASSERT(PosIsOk());
     }
 
+    template<Color us>
     void Board::makeCastle(Square from, Square to)
     {
         BitBoard rook;
@@ -739,47 +755,32 @@ namespace Napoleon
 
         if (from < to) // Castle O-O
         {
-            if (sideToMove == PieceColor::White)
-            {
-                fromR = Constants::Squares::IntH1;
-                toR = Constants::Squares::IntF1;
-            }
-            else
-            {
-                fromR = Constants::Squares::IntH8;
-                toR = Constants::Squares::IntF8;
-            }
+            fromR = us == PieceColor::White ? Constants::Squares::IntH1 : Constants::Squares::IntH8;
+            toR = us == PieceColor::White ? Constants::Squares::IntF1 : Constants::Squares::IntF8;
         }
         else // Castle O-O-O
         {
-            if (sideToMove == PieceColor::White)
-            {
-                fromR = Constants::Squares::IntA1;
-                toR = Constants::Squares::IntD1;
-            }
-            else
-            {
-                fromR = Constants::Squares::IntA8;
-                toR = Constants::Squares::IntD8;
-            }
+            fromR = us == PieceColor::White ? Constants::Squares::IntA1 : Constants::Squares::IntA8;
+            toR = us == PieceColor::White ? Constants::Squares::IntD1 : Constants::Squares::IntD8;
         }
 
         rook = Constants::Masks::SquareMask[fromR] | Constants::Masks::SquareMask[toR];
-        pieces[sideToMove] ^= rook;
-        bitBoardSet[sideToMove][PieceType::Rook] ^= rook;
+        pieces[us] ^= rook;
+        bitBoardSet[us][PieceType::Rook] ^= rook;
         OccupiedSquares ^= rook;
         EmptySquares ^= rook;
         pieceSet[fromR] = Constants::Piece::Null; // sposta la torre
-        pieceSet[toR] = Piece(sideToMove, PieceType::Rook); // sposta la torre
+        pieceSet[toR] = Piece(us, PieceType::Rook); // sposta la torre
 
-        updatePstvalue<Sub>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, PieceType::Rook), fromR));
-        updatePstvalue<Add>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, PieceType::Rook), toR));
+        updatePstvalue<Sub>(us, Evaluation::PieceSquareValue(Piece(us, PieceType::Rook), fromR));
+        updatePstvalue<Add>(us, Evaluation::PieceSquareValue(Piece(us, PieceType::Rook), toR));
 
-        zobrist ^= Zobrist::Piece[sideToMove][PieceType::Rook][fromR];
-        zobrist ^= Zobrist::Piece[sideToMove][PieceType::Rook][toR];
-        castled[sideToMove] = true;
+        zobrist ^= Zobrist::Piece[us][PieceType::Rook][fromR];
+        zobrist ^= Zobrist::Piece[us][PieceType::Rook][toR];
+        castled[us] = true;
     }
 
+    template<Color us>
     void Board::undoCastle(Square from, Square to)
     {
         BitBoard rook;
@@ -788,47 +789,29 @@ namespace Napoleon
 
         if (from < to) // Castle O-O
         {
-            if (sideToMove == PieceColor::White)
-            {
-                fromR = Constants::Squares::IntH1;
-                toR = Constants::Squares::IntF1;
-            }
-            else
-            {
-                fromR = Constants::Squares::IntH8;
-                toR = Constants::Squares::IntF8;
-            }
+            fromR = us == PieceColor::White ? Constants::Squares::IntH1 : Constants::Squares::IntH8;
+            toR = us == PieceColor::White ? Constants::Squares::IntF1 : Constants::Squares::IntF8;
         }
         else // Castle O-O-O
         {
-            if (sideToMove == PieceColor::White)
-            {
-                fromR = Constants::Squares::IntA1;
-                toR = Constants::Squares::IntD1;
-            }
-            else
-            {
-                fromR = Constants::Squares::IntA8;
-                toR = Constants::Squares::IntD8;
-            }
+            fromR = us == PieceColor::White ? Constants::Squares::IntA1 : Constants::Squares::IntA8;
+            toR = us == PieceColor::White ? Constants::Squares::IntD1 : Constants::Squares::IntD8;
         }
 
         rook = Constants::Masks::SquareMask[fromR] | Constants::Masks::SquareMask[toR];
-        pieces[sideToMove] ^= rook;
-        bitBoardSet[sideToMove][PieceType::Rook] ^= rook;
+        pieces[us] ^= rook;
+        bitBoardSet[us][PieceType::Rook] ^= rook;
         OccupiedSquares ^= rook;
         EmptySquares ^= rook;
-        pieceSet[fromR] = Piece(sideToMove, PieceType::Rook); // sposta la torre
+        pieceSet[fromR] = Piece(us, PieceType::Rook); // sposta la torre
         pieceSet[toR] = Constants::Piece::Null; // sposta la torre
 
-        updatePstvalue<Add>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, PieceType::Rook), fromR));
-        updatePstvalue<Sub>(sideToMove, Evaluation::PieceSquareValue(Piece(sideToMove, PieceType::Rook), toR));
-
-        castlingStatus = castlingStatusHistory[currentPly]; // ripristina i diritti di arrocco dello stato precedente
+        updatePstvalue<Add>(us, Evaluation::PieceSquareValue(Piece(us, PieceType::Rook), fromR));
+        updatePstvalue<Sub>(us, Evaluation::PieceSquareValue(Piece(us, PieceType::Rook), toR));
 
-        zobrist ^= Zobrist::Piece[sideToMove][PieceType::Rook][fromR];
-        zobrist ^= Zobrist::Piece[sideToMove][PieceType::Rook][toR];
-        castled[sideToMove] = false;
+        zobrist ^= Zobrist::Piece[us][PieceType::Rook][fromR];
+        zobrist ^= Zobrist::Piece[us][PieceType::Rook][toR];
+        castled[us] = false;
     }
 
     bool Board::IsAttacked(BitBoard target, Color side) const
@@ -867,6 +850,84 @@ namespace Napoleon
         return false;
     }
 
+    // true if the move could have been generated in this position, pins aside (IsMoveLegal checks them).
+    // Validates moves coming from elsewhere (hash table, killers) before they are searched
+    bool Board::IsPseudoLegal(Move move)
+    {
+        using namespace Constants::Masks;
+
+        Square from = move.FromSquare();
+        Square to = move.ToSquare();
+        Piece piece = pieceSet[from];
+        BitBoard checkers;
+        BitBoard targets;
+
+        if (move.IsNull() || piece.Type == PieceType::None || piece.Color != sideToMove)
+            return false;
+
+        checkers = KingAttackers(kingSquare[sideToMove], sideToMove);
+
+        if (move.IsCastle())
+        {
+            if (checkers)
+                return false;
+
+            Move castles[2];
+            int count = 0;
+            MoveGenerator::GetCastleMoves(*this, castles, count);
+
+            return (count > 0 && castles[0] == move) || (count > 1 && castles[1] == move);
+        }
+
+        // en passant captures are always generated, IsMoveLegal plays them out anyway
+        if (move.IsEnPassant())
+            return piece.Type == PieceType::Pawn && to == enPassantSquare
+                && (MoveDatabase::PawnAttacks[sideToMove][from] & SquareMask[to]);
+
+        Byte flag = move.Encode() >> 12;
+
+        if (flag != 0 && (flag < KnightPromotion || flag > QueenPromotion))
+            return false;
+
+        switch (piece.Type)
+        {
+            case PieceType::Pawn:
+                // promotions are the only pawn moves to the last rank and vice versa
+                if (move.IsPromotion() != (Utils::Square::GetRankIndex(to) == Utils::Square::RelativeRank(sideToMove, 7)))
+                    return false;
+                targets = Pawn::GetAllTargets(SquareMask[from], *this);
+                break;
+
+            case PieceType::Knight: targets = Knight::GetAllTargets(SquareMask[from], *this); break;
+            case PieceType::Bishop: targets = Bishop::GetAllTargets(SquareMask[from], *this); break;
+            case PieceType::Rook: targets = Rook::GetAllTargets(SquareMask[from], *this); break;
+            case PieceType::Queen: targets = Queen::GetAllTargets(SquareMask[from], *this); break;
+            case PieceType::King: targets = King::GetAllTargets(SquareMask[from], *this); break;
+            default: return false;
+        }
+
+        if (move.IsPromotion() && piece.Type != PieceType::Pawn)
+            return false;
+
+        if ((targets & SquareMask[to]) == 0)
+            return false;
+
+        // same restrictions as MoveGenerator::GetLegal in check
+        if (checkers)
+        {
+            if (piece.Type == PieceType::King) // the king must not stay on the line of a slider
+                return AttacksTo(to, Utils::Piece::GetOpposite(sideToMove), OccupiedSquares ^ SquareMask[from]) == 0;
+
+            if (checkers & (checkers - 1)) // double check
+                return false;
+
+            Square checksq = Utils::BitBoard::BitScanForward(checkers);
+            return ((MoveDatabase::ObstructedTable[checksq][kingSquare[sideToMove]] | checkers) & SquareMask[to]) != 0;
+        }
+
+        return true;
+    }
+
     std::string Board::GetFen() const
     {
         using namespace Utils::Square;
@@ -8,15 +8,98 @@
 #include "zobrist.h"
 #include "uci.h"
 #include "pawn.h"
+#include "materialtable.h"
 #include <cassert>
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <memory>
 
 namespace Napoleon
 {
     class MoveList;
     class FenString;
+
+    // state that MakeMove() cannot recompute, saved to restore the board in UndoMove()
+    class StateInfo
+    {
+        public:
+            ZobristKey hash; // checked for repetitions
+            int halfMoveClock;
+            Byte castlingStatus;
+            Byte enPassantSquare; // squares fit a byte, keeps the entry at 16 bytes
+            Type capturedPiece;
+            Byte reversible; // plies since the last irreversible move (saturated), set by StateStack
+    };
+
+    // undo stack of a board. The entries live outside the board, allocated once with the
+    // stack: assigning a board reuses the entries of the target, and a copy only takes the
+    // entries since the last irreversible move, the only ones repetition detection needs
+    class StateStack
+    {
+        public:
+            StateStack();
+            StateStack(const StateStack&);
+            StateStack& operator=(const StateStack&);
+
+            void Clear();
+            void Push(const StateInfo&);
+            const StateInfo& Pop();
+            const StateInfo& Top() const;
+            void Irreversible();
+            int Ply() const;
+            bool Repeats(ZobristKey) const;
+
+        private:
+            std::unique_ptr<StateInfo[]> entries; // Constants::MaxPly
+            int first; // ply of entries[0]
+            int ply; // plies played, entries[ply - first] is the next free one
+            int live; // first ply that the current position can repeat
+    };
+
+    inline void StateStack::Push(const StateInfo& state)
+    {
+        StateInfo& entry = entries[ply - first];
+        entry = state;
+        entry.reversible = Byte(std::min(ply - live, 255));
+        ply++;
+    }
+
+    // the half move clock cannot restore live: null moves do not advance it
+    inline const StateInfo& StateStack::Pop()
+    {
+        const StateInfo& state = entries[--ply - first];
+        live = ply - state.reversible;
+        return state;
+    }
+
+    inline const StateInfo& StateStack::Top() const
+    {
+        return entries[ply - 1 - first];
+    }
+
+    // the last move pushed reset the half move clock
+    inline void StateStack::Irreversible()
+    {
+        live = ply;
+    }
+
+    inline int StateStack::Ply() const
+    {
+        return ply;
+    }
+
+    // positions with the same side to move since the last irreversible move
+    inline bool StateStack::Repeats(ZobristKey key) const
+    {
+        for (int i = ply - 2; i >= live && i >= first; i -= 2)
+        {
+            if (entries[i - first].hash == key)
+                return true;
+        }
+        return false;
+    }
+
     class Board
     {
         public:
@@ -28,6 +111,7 @@ namespace Napoleon
 
             ZobristKey zobrist;
             ZobristKey pawnKey; // pawns and king zobrist key
+            ZobristKey materialKey; // number of pieces of each type, updated next to numOfPieces
 
             Board();
 
@@ -47,6 +131,7 @@ namespace Napoleon
             std::pair<BitBoard, Type> LeastValuableAttacker(Color, BitBoard) const;
 
             int See(Move) const;
+            ZobristKey ZobristAfter(Move) const;
 
             Piece PieceOnSquare(Square) const;
             const Piece* PieceList() const;
@@ -60,6 +145,7 @@ namespace Napoleon
 
             bool IsCapture(Move) const;
             bool IsMoveLegal(Move, BitBoard);
+            bool IsPseudoLegal(Move);
             bool IsAttacked(BitBoard, Color) const;
             bool IsPromotingPawn() const;
             bool IsOnSquare(Color, Type, Square) const;
@@ -103,13 +189,6 @@ namespace Napoleon
             Move ParseMove(std::string) const;
 
         private:
-            // used to restore previous board state after MakeMove()
-            Byte castlingStatusHistory[Constants::MaxPly];
-            Type capturedPieceHistory[Constants::MaxPly];
-            Square enpSquaresHistory[Constants::MaxPly];
-            ZobristKey hashHistory[Constants::MaxPly]; // only useful for debugging (check if previous computed hash != actual hash)
-            int halfMoveClockHistory[Constants::MaxPly];
-
             BitBoard bitBoardSet[2][6]; // color, type
             Square kingSquare[2]; // color
 
@@ -121,7 +200,6 @@ namespace Napoleon
             Square enPassantSquare;
 
             int halfMoveClock;
-            int currentPly;
             bool allowNullMove;
             bool isCheck;
             bool castled[2] = {false, false}; // color
@@ -129,6 +207,8 @@ namespace Napoleon
             int numOfPieces[2][6]; // color, type
             int pawnsOnFile[2][8]; // color, file
 
+            StateStack states; // one entry per move played
+
             Score pstValue[2]; // color
             int material[2]; // color
 
@@ -143,7 +223,13 @@ namespace Napoleon
             void initializeEnPassantSquare(const FenString&);
             void initializeHalfMoveClock(const FenString&);
             void initializePieceSet(const FenString&);
+            template<Color>
+            void makeMove(Move);
+            template<Color>
+            void undoMove(Move);
+            template<Color>
             void makeCastle(Square, Square);
+            template<Color>
             void undoCastle(Square, Square);
             Score calculatePST(Color) const;
     };
@@ -276,8 +362,7 @@ namespace Napoleon
 
     inline void Board::MakeNullMove()
     {
-        hashHistory[currentPly] = zobrist;
-        enpSquaresHistory[currentPly] = enPassantSquare;
+        states.Push({ zobrist, halfMoveClock, castlingStatus, static_cast<Byte>(enPassantSquare), PieceType::None, 0 });
         sideToMove = Utils::Piece::GetOpposite(sideToMove);
         enPassantSquare = Constants::Squares::Invalid;
 
@@ -289,28 +374,26 @@ namespace Napoleon
             pawnKey ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enPassantSquare)];
         }
 
-        if (enpSquaresHistory[currentPly] != Constants::Squares::Invalid)
+        if (states.Top().enPassantSquare != Constants::Squares::Invalid)
         {
-            zobrist ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enpSquaresHistory[currentPly])];
-            pawnKey ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enpSquaresHistory[currentPly])];
+            zobrist ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(states.Top().enPassantSquare)];
+            pawnKey ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(states.Top().enPassantSquare)];
         }
 
         allowNullMove = false;
-        currentPly++;
     }
 
     inline void Board::UndoNullMove()
     {
-        currentPly--;
         sideToMove = Utils::Piece::GetOpposite(sideToMove);
-        enPassantSquare = enpSquaresHistory[currentPly];
+        enPassantSquare = states.Pop().enPassantSquare;
 
         zobrist ^= Zobrist::Color;
 
-        if (enpSquaresHistory[currentPly] != Constants::Squares::Invalid)
+        if (enPassantSquare != Constants::Squares::Invalid)
         {
-            zobrist ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enpSquaresHistory[currentPly])];
-            pawnKey ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enpSquaresHistory[currentPly])];
+            zobrist ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enPassantSquare)];
+            pawnKey ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enPassantSquare)];
         }
 
         allowNullMove = true;
@@ -338,7 +421,7 @@ namespace Napoleon
 
     inline int Board::CurrentPly() const
     {
-        return currentPly;
+        return states.Ply();
     }
 
     inline bool Board::AllowNullMove() const
@@ -524,6 +607,49 @@ namespace Napoleon
         return gain[0];
     }
 
+    // zobrist key of the position reached by the move, computed without making it.
+    // Castles and promotions are not handled: the key is only used to prefetch
+    INLINE ZobristKey Board::ZobristAfter(Move move) const
+    {
+        Square from = move.FromSquare();
+        Square to = move.ToSquare();
+        Type moved = pieceSet[from].Type;
+        Type captured = pieceSet[to].Type;
+
+        ZobristKey key = zobrist ^ Zobrist::Color
+            ^ Zobrist::Piece[sideToMove][moved][from]
+            ^ Zobrist::Piece[sideToMove][moved][to];
+
+        if (captured != PieceType::None)
+            key ^= Zobrist::Piece[Utils::Piece::GetOpposite(sideToMove)][captured][to];
+
+        if (enPassantSquare != Constants::Squares::Invalid)
+            key ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(enPassantSquare)];
+
+        if (moved == PieceType::Pawn && (to - from == 16 || from - to == 16))
+            key ^= Zobrist::Enpassant[Utils::Square::GetFileIndex(to)];
+
+        if (castlingStatus)
+        {
+            using namespace Constants::Squares;
+            using namespace Constants::Castle;
+
+            Byte castling = castlingStatus;
+
+            if (moved == PieceType::King)
+                castling &= sideToMove == PieceColor::White ? ~(WhiteCastleOO | WhiteCastleOOO) : ~(BlackCastleOO | BlackCastleOOO);
+            if (from == IntA1 || to == IntA1) castling &= ~WhiteCastleOOO;
+            if (from == IntH1 || to == IntH1) castling &= ~WhiteCastleOO;
+            if (from == IntA8 || to == IntA8) castling &= ~BlackCastleOOO;
+            if (from == IntH8 || to == IntH8) castling &= ~BlackCastleOO;
+
+            if (castling != castlingStatus)
+                key ^= Zobrist::Castling[castling];
+        }
+
+        return key;
+    }
+
     inline int Board::MinorPieces(Color c) const
     {
         return NumOfPieces(c, PieceType::Bishop) + NumOfPieces(c, PieceType::Knight);
@@ -539,49 +665,30 @@ namespace Napoleon
         using namespace Utils::BitBoard;
         using namespace Constants;
 
-        // Material draw detection
+        // Material draw detection (cached in the material table)
         if (EndGame())
         {
-            if (NumOfPieces(PieceType::Queen) + 
-                    NumOfPieces(PieceType::Rook) +
-                    NumOfPieces(PieceType::Pawn) == 0)
-            {
-                if (MinorPieces() == 0) // KK
-                    return true;
+            Byte flags = Evaluation::materialTable.Probe(*this).Flags();
 
-                for (auto c = PieceColor::White; c < PieceColor::None; c++)
-                {
-                    auto enemy = GetOpposite(c);
-                    if (MinorPieces(c) == 1 && MinorPieces(enemy) == 0) // KN+K, KB+K
-                        return true;
-                    if (NumOfPieces(c, PieceType::Knight) == 2 && MinorPieces(enemy) == 0) //KNN+K
-                        return true;
-                }
-                if (NumOfPieces(PieceColor::White, PieceType::Bishop) == 1 
-                        && NumOfPieces(PieceColor::Black, PieceType::Bishop) == 1) // KB+KB same color
+            if (flags & MaterialEntry::Drawn)
+                return true;
+
+            if (flags & MaterialEntry::BishopsDraw) // KB+KB same color
+            {
+                if (Pieces(PieceColor::White, PieceType::Bishop) & LightSquares)
                 {
-                    if (Pieces(PieceColor::White, PieceType::Bishop) & LightSquares)
-                    {
-                        if (Pieces(PieceColor::Black, PieceType::Bishop) & LightSquares)
-                            return true;
-                    }
-                    else if (Pieces(PieceColor::Black, PieceType::Bishop) & DarkSquares)
+                    if (Pieces(PieceColor::Black, PieceType::Bishop) & LightSquares)
                         return true;
                 }
-
+                else if (Pieces(PieceColor::Black, PieceType::Bishop) & DarkSquares)
+                    return true;
             }
         }
 
         // threefold repetition
-        if (halfMoveClock >= 4)
-        {
-            int start = SideToMove() == PieceColor::White ? 0 : 1;
-            for (int i = start; i < currentPly; i += 2)
-            {
-                if (hashHistory[i] == zobrist)
-                    return true;
-            }
-        }
+        if (halfMoveClock >= 4 && states.Repeats(zobrist))
+            return true;
+
         return false;
     }
 
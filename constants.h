@@ -316,8 +316,14 @@ namespace Napoleon
             const int RookBonus[3] = { 0, 5, 15 };
             const int PasserBonus[3] = {20, 30, 40};
             const int HalfOpenFileBonus[3] = {5, 8, 0}; // OpenFileBonus = HalfOpenFileBonus*2
+            const int PawnThreat[3] = {30, 35, 40}; // per minor or major piece attacked by an enemy pawn
+            const int HangingPiece[3] = {10, 15, 20}; // per minor or major piece attacked and not defended
 
             const int MaxPhase = 256;
+            // not a bound: the terms skipped by lazy evaluation can exceed it (king attacks
+            // alone reach 519). Of 400, 600, 900 and 1200, 900 gave the fewest nodes and the
+            // shortest time to depth 12 over eight test positions, 4% fewer nodes than no exit
+            const int LazyMargin = 900;
             //            const int MaxNonPawnMaterial = PieceValue[PieceType::Knight]*4;
         }
 
@@ -4,11 +4,13 @@
 #include "bishop.h"
 #include "knight.h"
 #include "queen.h"
+#include <algorithm>
 #include <cassert>
 
 namespace Napoleon
 {
     PawnTable Evaluation::pawnTable;
+    MaterialTable Evaluation::materialTable;
 
     int Evaluation::multiPawnP[8] = { 0, 0, 10, 20, 35, 50, 75, 100 }; // TODO: add phase dependent penalties
     int Evaluation::isolatedPawnP[8] = { 5, 7, 10, 18, 18, 10, 7, 5 }; // TODO: add phase dependent penalties
@@ -115,15 +117,11 @@ namespace Napoleon
         519, 519, 519, 519, 519, 519, 519, 519, 519, 519, 
     };
 
-    BitBoard Evaluation::pawnAttacks[2]; // color
-    BitBoard Evaluation::unpinnedKnightAttacks[2]; // color
-    BitBoard attacks[2] = {0}; // all squares attacked by each color
-    int Evaluation::hangingValue[2] = {0}; // color
-
-    int kingAttacksCount[2] = {0}; // color
-
-
-    int Evaluation::Evaluate(Board& board)
+    // the evaluation stops after material, piece square and pawn terms when they are
+    // LazyMargin outside (alpha, beta): context.lazy is set and that partial score is returned.
+    // The skipped terms (mobility, king attacks, forks, pins) are not bounded by the margin,
+    // so a lazy score may fall on the wrong side of the window
+    int Evaluation::evaluate(Board& board, EvalContext& context, int alpha, int beta)
     {
         using namespace Constants::Squares;
         using namespace Constants::Castle;
@@ -151,10 +149,7 @@ namespace Napoleon
             MoveDatabase::KingProximity[Black][bking_square]
         };
 
-        attacks[White] = attacks[Black] = 0;
-        unpinnedKnightAttacks[White] = unpinnedKnightAttacks[Black] = 0;
-        hangingValue[White] = hangingValue[Black] = 0;
-        kingAttacksCount[White] = kingAttacksCount[Black] = 0;
+        context.kingAttacksCount[White] = context.kingAttacksCount[Black] = 0;
 
         // material evaluation
         int material = board.MaterialBalance(White);
@@ -165,16 +160,9 @@ namespace Napoleon
 
         updateScore(scores, material + (wPstValues.first - bPstValues.first), material + (wPstValues.second - bPstValues.second));
 
-        /* PHASE-DEPENDENT piece bonus*/
-        int wKnights = board.NumOfPieces(White, Knight);
-        int bKnights = board.NumOfPieces(Black, Knight);
-        updateScore(scores, KnightBonus[Opening]*wKnights, KnightBonus[EndGame]*wKnights);
-        updateScore(scores, -KnightBonus[Opening]*bKnights, -KnightBonus[EndGame]*bKnights);
-
-        int wRooks = board.NumOfPieces(White, Rook);
-        int bRooks = board.NumOfPieces(Black, Rook);
-        updateScore(scores, RookBonus[Opening]*wRooks, RookBonus[EndGame]*wRooks);
-        updateScore(scores, -RookBonus[Opening]*bRooks, -RookBonus[EndGame]*bRooks);
+        // phase-dependent piece bonus and bishop pair (cached in the material table)
+        MaterialEntry materialEntry = materialTable.Probe(board);
+        updateScore(scores, materialEntry.Imbalance());
 
 
         // premature queen development
@@ -190,23 +178,9 @@ namespace Napoleon
         else
             updateScore(scores, -5);
 
-        // bishop pair bonus
-        if (board.NumOfPieces(White, PieceType::Bishop) == 2)
-            updateScore(scores, BishopPair[Opening], BishopPair[EndGame]);
-
-        if (board.NumOfPieces(Black, PieceType::Bishop) == 2)
-            updateScore(scores, -BishopPair[Opening], -BishopPair[EndGame]);
 
-
-        auto entry = pawnTable.at(board.pawnKey); 
-        bool probed = false;
-        if (entry->key == board.pawnKey) // PAWN HASH-HIT
-        {
-            pawnStructure = entry->score;
-            pawnAttacks[White] = entry->attacks[White]; 
-            pawnAttacks[Black] = entry->attacks[Black];
-            probed = true;
-        }
+        PawnEntry entry;
+        bool probed = pawnTable.Probe(board.pawnKey, entry);
 
         /* PAWN STRUCTURE */    
         // doubled/isolated pawns evaluation
@@ -224,6 +198,9 @@ namespace Napoleon
             Byte wpawnset = (Byte) Utils::BitBoard::SouthFill(wpawns);
             Byte bpawnset = (Byte) Utils::BitBoard::SouthFill(bpawns);
 
+            entry.halfOpenFiles[White] = ~wpawnset;
+            entry.halfOpenFiles[Black] = ~bpawnset;
+
             int wislands = PopCount(wpawnset & (wpawnset ^ (wpawnset >> 1)));
             int bislands = PopCount(bpawnset & (bpawnset ^ (bpawnset >> 1)));
 
@@ -262,9 +239,9 @@ namespace Napoleon
                 }
             }
 
-            entry->attacks[White] = pawnAttacks[White] = 
+            entry.attacks[White] = 
                 Pawn::GetAnyAttack(board.Pieces(White, PieceType::Pawn), White, Constants::Universe); // squares attacked by White pawns
-            entry->attacks[Black] = pawnAttacks[Black] = 
+            entry.attacks[Black] = 
                 Pawn::GetAnyAttack(board.Pieces(Black, PieceType::Pawn), Black, Constants::Universe); // squares attacked by Black pawns
         }
 
@@ -285,6 +262,39 @@ namespace Napoleon
             }
         }
 
+        if (!probed)
+        {
+            // pawn shelter of both wings, only the one of the current king position is used
+            entry.shelter[White][0] = evaluateShelter(White, wpawns, WhiteQueenShield);
+            entry.shelter[White][1] = evaluateShelter(White, wpawns, WhiteKingShield);
+            entry.shelter[Black][0] = evaluateShelter(Black, bpawns, BlackQueenShield);
+            entry.shelter[Black][1] = evaluateShelter(Black, bpawns, BlackKingShield);
+
+            entry.score = pawnStructure;
+            pawnTable.Save(board.pawnKey, entry);
+        }
+        else // PAWN HASH-HIT
+            pawnStructure = entry.score;
+
+        context.attackedBy[White][Pawn] = entry.attacks[White];
+        context.attackedBy[Black][Pawn] = entry.attacks[Black];
+
+        context.halfOpenFiles[White] = entry.halfOpenFiles[White];
+        context.halfOpenFiles[Black] = entry.halfOpenFiles[Black];
+
+        int phase = materialEntry.Phase(); // game phase (0-256)
+        int side = 1-(board.SideToMove()*2);
+
+        // lazy evaluation
+        int partial = interpolate(Score(scores.first + pawnStructure.first, scores.second + pawnStructure.second), phase) * side;
+        if (partial - LazyMargin >= beta || partial + LazyMargin <= alpha)
+        {
+            context.lazy = true;
+            return partial;
+        }
+
+        computeAttacks(board, context);
+
         // pinned pieces penalty
         BitBoard pinned = board.PinnedPieces(); // TODO: may be sent by search
         updateScore(scores, -10*PopCount(pinned & board.Pieces(White)));
@@ -321,11 +331,10 @@ namespace Napoleon
             if (piece.Type != PieceType::None && piece.Type != Pawn && piece.Type != King)
             {
                 enemy = GetOpposite(piece.Color);
-                updateScore(scores, EvaluatePiece(piece, sq, king_proximity[enemy], board)); // opponent's king proximity
+                updateScore(scores, EvaluatePiece(piece, sq, king_proximity[enemy], board, context)); // opponent's king proximity
             }
         }
 
-        pawnTable.Save(board.pawnKey, pawnStructure);
         updateScore(scores, pawnStructure);
 
         // pseudo knight-forks evaluation
@@ -333,7 +342,7 @@ namespace Napoleon
            for(Color c = White; c < PieceColor::None; c++)
            {
            Color enemy = GetOpposite(c);
-           if(PopCount(unpinnedKnightAttacks[c] & 
+           if(PopCount(context.attackedBy[c][Knight] & 
            (board.Pieces(enemy, King) 
            | board.Pieces(enemy, Queen) 
            | board.Pieces(enemy, Rook))) >= 2)
@@ -348,89 +357,91 @@ namespace Napoleon
         //KING SAFETY
         //king attacks table application (incrementally computed piece by piece)
         //TODO: try not to scale down
-        updateScore(scores, kingAttacks[kingAttacksCount[White]], kingAttacks[kingAttacksCount[White]]/2);
-        updateScore(scores, -kingAttacks[kingAttacksCount[Black]], -kingAttacks[kingAttacksCount[Black]]/2);
-
-        //pawn shelter
-        int shelter1 = 0, shelter2 = 0;
-
-        if (kingFile[White] > Constants::Files::IntE)
+        //distant rooks and bishops can drive the count below zero
+        int wKingAttacks = kingAttacks[std::max(0, std::min(context.kingAttacksCount[White], 199))];
+        int bKingAttacks = kingAttacks[std::max(0, std::min(context.kingAttacksCount[Black], 199))];
+        updateScore(scores, wKingAttacks, wKingAttacks/2);
+        updateScore(scores, -bKingAttacks, -bKingAttacks/2);
+
+        //pawn shelter (cached in the pawn table for both wings)
+        for (Color c = White; c < PieceColor::None; c++)
         {
-            shelter1 = PopCount(wpawns & WhiteKingShield);
-            shelter2 = PopCount(wpawns & OneStepNorth(WhiteKingShield));
+            if (kingFile[c] > Constants::Files::IntE)
+                updateScore(scores, entry.shelter[c][1]); // king side
+            else if (kingFile[c] < Constants::Files::IntD)
+                updateScore(scores, entry.shelter[c][0]); // queen side
+            // else apply penalty
         }
-        else if (kingFile[White] < Constants::Files::IntD)
-        {
-            shelter1 = PopCount(wpawns & WhiteQueenShield);
-            shelter2 = PopCount(wpawns & OneStepNorth(WhiteQueenShield));
-        }
-        // else apply penalty
 
-        updateScore(scores, shelter1 * 5.5 + shelter2 * 2, shelter1 + shelter2 ); // shielding bonus
 
-        shelter1 = shelter2 = 0;
-        if (kingFile[Black] > Constants::Files::IntE)
-        {
-            shelter1 = PopCount(bpawns & BlackKingShield);
-            shelter2 = PopCount(bpawns & OneStepSouth(BlackKingShield));
-        }
-        else if (kingFile[Black] < Constants::Files::IntD)
+        // THREATS: pieces attacked by enemy pawns, and pieces attacked but not defended
+        for (Color c = White; c < PieceColor::None; c++)
         {
-            shelter1 = PopCount(bpawns & BlackQueenShield);
-            shelter2 = PopCount(bpawns & OneStepSouth(BlackQueenShield));
+            enemy = GetOpposite(c);
+            int sign = c == White ? -1 : 1; // penalty for the threatened side
+            BitBoard pieces = board.Pieces(c) & ~board.Pieces(c, Pawn) & ~board.Pieces(c, King);
+            int threatened = PopCount(pieces & context.attackedBy[enemy][Pawn]);
+            int hanging = PopCount(pieces & context.attackedBy[enemy][PieceType::None] & ~context.attackedBy[c][PieceType::None]);
+
+            updateScore(scores, sign * (threatened*PawnThreat[Opening] + hanging*HangingPiece[Opening]),
+                        sign * (threatened*PawnThreat[EndGame] + hanging*HangingPiece[EndGame]));
         }
-        // else apply penalty
 
-        updateScore(scores, -(shelter1 * 5.5 + shelter2 * 2), -shelter1 -shelter2); // shielding bonus
+        //TODO: check whether the king is in castle position
 
+        int opening = scores.first; // opening score
+        int endgame = scores.second; // endgame score
 
-        /* DISABLED TO TEST MOBILITY VARIATION
-        // HANGING PIECES:
-        bool eval_hanging = hanging
-        && attacks[White]
-        && attacks[Black];
+        int score = ((opening * (Constants::Eval::MaxPhase - phase)) + (endgame * phase)) / Constants::Eval::MaxPhase; // linear-interpolated score
 
-        if (eval_hanging)
-        {
-        attacks[White] |= pawnAttacks[White];
-        attacks[Black] |= pawnAttacks[Black];
-        }
+        return score * side; // score relative to side to move
+    }
 
-        for (Color c = White; eval_hanging && c < PieceColor::None; c++)
-        {
-        for (Type piece = PieceType::Queen; piece > PieceType::Pawn; piece--)
-        {
-        BitBoard pieces = board.Pieces(c, piece);
-        bool found = false;
-        while(pieces)
-        {
-        auto sq = BitScanForwardReset(pieces);
-        enemy = GetOpposite(c);
-        if(attacks[enemy] & SquareMask[sq])
+
+    // attack maps of both colors, computed once and shared by mobility, king safety,
+    // outposts and threats. Pawn attacks must already be set from the pawn entry
+    void Evaluation::computeAttacks(Board& board, EvalContext& context)
+    {
+        using namespace Utils::BitBoard;
+        using namespace PieceColor;
+
+        BitBoard occupied = board.OccupiedSquares;
+
+        for (Color c = White; c < PieceColor::None; c++)
         {
-        hangingValue[c] = PieceValue[piece];
-        found = true;
-        break;
-        }
-        }
-        if (found) break;
-        }
-        }
-        */
+            BitBoard all = context.attackedBy[c][Pawn];
 
-        //TODO: check whether the king is in castle position
+            for (Type type = Knight; type < King; type++)
+            {
+                BitBoard pieces = board.Pieces(c, type);
+                BitBoard attacks = 0;
 
-        int opening = scores.first; // opening score
-        int endgame = scores.second; // endgame score
-        int phase = board.Phase(); // game phase (0-256)
+                while (pieces)
+                {
+                    Napoleon::Square sq = BitScanForwardReset(pieces);
+                    BitBoard b = 0;
+
+                    if (type == Knight)
+                        b = MoveDatabase::KnightAttacks[sq];
+                    if (type == Bishop || type == Queen)
+                        b |= MoveDatabase::GetA1H8DiagonalAttacks(occupied, sq) | MoveDatabase::GetH1A8DiagonalAttacks(occupied, sq);
+                    if (type == Rook || type == Queen)
+                        b |= MoveDatabase::GetRookAttacks(occupied, sq);
+
+                    context.pieceAttacks[sq] = b;
+                    attacks |= b;
+                }
 
-        int score = ((opening * (Constants::Eval::MaxPhase - phase)) + (endgame * phase)) / Constants::Eval::MaxPhase; // linear-interpolated score
+                context.attackedBy[c][type] = attacks;
+                all |= attacks;
+            }
 
-        return score * (1-(board.SideToMove()*2)); // score relative to side to move
+            context.attackedBy[c][King] = MoveDatabase::KingAttacks[board.KingSquare(c)];
+            context.attackedBy[c][PieceType::None] = all | context.attackedBy[c][King];
+        }
     }
 
-
-    Score Evaluation::EvaluatePiece(Piece piece, Square square, BitBoard king_proxy, Board& board)
+    Score Evaluation::EvaluatePiece(Piece piece, Square square, BitBoard king_proxy, Board& board, EvalContext& context)
     {
         using namespace Utils::BitBoard;
         using namespace Utils::Piece;
@@ -439,7 +450,7 @@ namespace Napoleon
 
         Color us = piece.Color;
         Color enemy = GetOpposite(us);
-        BitBoard b = 0;
+        BitBoard b = context.pieceAttacks[square] & ~board.Pieces(us); // mobility targets
         int tropism = 0;
         int distance = 7; // longest distance
         Square ksq = board.KingSquare(enemy); // enemy king
@@ -450,42 +461,34 @@ namespace Napoleon
         switch(piece.Type)
         {
             case PieceType::Knight:
-                b = Knight::TargetsFrom(square, us, board);
-
-                //if (!(SquareMask[square] & pinned)) // only save unpinned knight attacks
-                //unpinnedKnightAttacks[us] |= b; // used to evaluate knight forks
-
                 tropism = 2; 
                 distance = MoveDatabase::Distance[square][ksq];
-                b &= ~pawnAttacks[enemy];
-                updateScore(bonus, evaluateOutpost(us, square, board));
+                b &= ~context.attackedBy[enemy][Pawn];
+                updateScore(bonus, evaluateOutpost(us, square, board, context));
                 break;
 
             case PieceType::Bishop:
-                b = Bishop::TargetsFrom(square, us, board);
                 tropism = 2; // TO TEST: divide by distance to king
                 distance = MoveDatabase::Distance[square][ksq]*2;
                 break;
 
             case PieceType::Rook:
-                b = Rook::TargetsFrom(square, us, board);
                 tropism = 4;
                 distance = MoveDatabase::Distance[square][ksq]*3;
                 file = Utils::Square::GetFileIndex(square);
 
-                ///if(MoveDatabase::FrontSpan[us][square] & entry->passers[enemy])
+                ///if(MoveDatabase::FrontSpan[us][square] & context.passers[enemy])
                 ///updateScore(bonus, supportedPassed[Opening], supportedPassed[EndGame]);
 
-                if((FileMask[file] & board.Pieces(PieceType::Pawn)) == 0) // OPEN FILE
+                if(context.halfOpenFiles[us] & context.halfOpenFiles[enemy] & (1 << file)) // OPEN FILE
                     updateScore(bonus, 2*HalfOpenFileBonus[Opening], 2*HalfOpenFileBonus[EndGame]);
 
-                else if((FileMask[file] & board.Pieces(us, PieceType::Pawn)) == 0) // HALF-OPEN FILE
+                else if(context.halfOpenFiles[us] & (1 << file)) // HALF-OPEN FILE
                     updateScore(bonus, HalfOpenFileBonus[Opening], HalfOpenFileBonus[EndGame]);
 
                 break;
 
             case PieceType::Queen:
-                b = Queen::TargetsFrom(square, us, board);
                 tropism = 6;
                 distance = MoveDatabase::Distance[square][ksq]/2;
                 break;
@@ -494,12 +497,10 @@ namespace Napoleon
                 return bonus;
         }
 
-        //attacks[us] |= b;
-
         int count = PopCount(b);
         // We consider the number of attacks to the king zone, weighted by piece type.
         // We then add up (7 - distance to the king):
-        kingAttacksCount[us] += tropism*PopCount(king_proxy & b) + (7 - distance); 
+        context.kingAttacksCount[us] += tropism*PopCount(king_proxy & b) + (7 - distance); 
 
         updateScore(bonus, mobilityBonus[Opening][piece.Type][count], 
                 mobilityBonus[EndGame][piece.Type][count]);
@@ -14,17 +14,48 @@
 namespace Napoleon
 {
     class Piece;
+
+    // direct-mapped cache of full evaluations, small enough to stay in L2
+    class EvalCache
+    {
+        public:
+            static const int Size = 16384; // entries (128 KB)
+
+            bool Probe(ZobristKey, int&) const;
+            void Save(ZobristKey, int);
+
+        private:
+            unsigned long long table[Size] = {}; // zobrist key (high 48 bits) | score (low 16 bits)
+    };
+
+    // scratch state filled by one evaluation. Every search thread owns its own context,
+    // aligned to a cache line so that contexts of different threads never share one
+    class alignas(64) EvalContext
+    {
+        public:
+            BitBoard attackedBy[2][PieceType::None + 1]; // color, piece type (PieceType::None: all pieces)
+            BitBoard pieceAttacks[64]; // square, squares attacked by the piece standing on it
+            int kingAttacksCount[2]; // color
+            Byte halfOpenFiles[2]; // color
+            EvalCache cache;
+            bool lazy; // the last evaluation stopped early (see Evaluation::evaluate)
+    };
+
     namespace Evaluation
     {
-        int Evaluate(Board&);
-        Score EvaluatePiece(Piece, Square, BitBoard, Board&);
+        int Evaluate(Board&, EvalContext&);
+        int Evaluate(Board&, EvalContext&, int, int);
+        int evaluate(Board&, EvalContext&, int, int);
+        Score EvaluatePiece(Piece, Square, BitBoard, Board&, EvalContext&);
         Score PieceSquareValue(Piece, Square);
         int KingSafety(Board&);
 
         void PrintEval(Board&);
 
         Score evaluatePawn(Color, Square, Board&);
-        Score evaluateOutpost(Color, Square, Board&);
+        Score evaluateShelter(Color, BitBoard, BitBoard);
+        Score evaluateOutpost(Color, Square, Board&, const EvalContext&);
+        void computeAttacks(Board&, EvalContext&);
         int interpolate(Score, int);
         void formatParam(std::string, int, int);
         void formatParam(std::string, Score, Score, int);
@@ -41,13 +72,50 @@ namespace Napoleon
         extern int pawnIslandsP[3][5]; // phase, number
         extern int mobilityBonus[3][7][Constants::QueenMaxMoves + 1];
         extern int backwardPawnP[3]; // phase
-        extern BitBoard pawnAttacks[2]; // color
-        extern BitBoard unpinnedKnightAttacks[2]; // color
         extern PawnTable pawnTable;
-        extern int hangingValue[2]; // color
         extern int kingAttacks[200]; // number of weighted attacks
     }
 
+    INLINE bool EvalCache::Probe(ZobristKey key, int& score) const
+    {
+        unsigned long long entry = table[key & (Size - 1)];
+
+        if ((entry ^ key) >> 16)
+            return false;
+
+        score = short(entry & 0xffff);
+        return true;
+    }
+
+    INLINE void EvalCache::Save(ZobristKey key, int score)
+    {
+        table[key & (Size - 1)] = (key & ~0xffffULL) | (unsigned short)score;
+    }
+
+    // positions are often evaluated again across iterations, the cache
+    // skips the piece loop for them. Scratch values in the context are not
+    // updated on a hit
+    INLINE int Evaluation::Evaluate(Board& board, EvalContext& context, int alpha, int beta)
+    {
+        int score;
+        context.lazy = false;
+
+        if (context.cache.Probe(board.zobrist, score))
+            return score;
+
+        score = evaluate(board, context, alpha, beta);
+
+        if (!context.lazy) // partial scores are only good for this window
+            context.cache.Save(board.zobrist, score);
+
+        return score;
+    }
+
+    INLINE int Evaluation::Evaluate(Board& board, EvalContext& context)
+    {
+        return Evaluate(board, context, -Constants::Infinity, Constants::Infinity);
+    }
+
     INLINE void Evaluation::updateScore(std::pair<int, int>& scores, int openingBonus, int endBonus)
     {
         scores.first += openingBonus;
@@ -99,7 +167,7 @@ namespace Napoleon
             if ((MoveDatabase::PasserSpan[color][square] & pawns[enemy]) == 0) // NO ENEMY PAWNS (i.e. PASSED PAWN)
             {
                 updateScore(score, passedPawn[Opening][rrank], passedPawn[EndGame][rrank]);
-                //SetBit(entry->passers[color], square);
+                //SetBit(entry.passers[color], square);
                 //tropism = 2;
             }
 
@@ -113,7 +181,7 @@ namespace Napoleon
                     if (defenders >= attackers) // CANDIDATE PASSER
                     {
                         updateScore(score, candidatePawn[Opening][rrank], candidatePawn[EndGame][rrank]);
-                        //SetBit(entry->passers[color], square);
+                        //SetBit(entry.passers[color], square);
                     }
                 }
 
@@ -129,7 +197,7 @@ namespace Napoleon
                 // * - stop square not defended by own pawns
                 // *   TODO: consider opposing backward pawns (the more advanced is not backward)
                 // *   TODO: consider backward pawns for king-pawn tropism evaluation
-                if ((stop & pawnAttacks[enemy]) && !(stop & pawnAttacks[color])) // BACKWARD PAWN
+                if ((stop & context.attackedBy[enemy][Pawn]) && !(stop & context.attackedBy[color][Pawn])) // BACKWARD PAWN
                 {
                 updateScore(score, -backwardPawnP[Opening], -backwardPawnP[EndGame]);
                 }
@@ -155,7 +223,21 @@ namespace Napoleon
     }
 
 
-    inline Score Evaluation::evaluateOutpost(Color color, Square square, Board& board)
+    // pawn shelter of a king on the wing protected by shield (first rank of the shelter)
+    inline Score Evaluation::evaluateShelter(Color color, BitBoard pawns, BitBoard shield)
+    {
+        using namespace PieceColor;
+        using namespace Utils::BitBoard;
+        using namespace CompassRose;
+
+        int shelter1 = PopCount(pawns & shield);
+        int shelter2 = PopCount(pawns & (color == White ? OneStepNorth(shield) : OneStepSouth(shield)));
+        Score bonus(int(shelter1 * 5.5 + shelter2 * 2), shelter1 + shelter2);
+
+        return color == White ? bonus : -bonus;
+    }
+
+    inline Score Evaluation::evaluateOutpost(Color color, Square square, Board& board, const EvalContext& context)
     {
         using namespace PieceColor;
         using namespace Utils::BitBoard;
@@ -167,7 +249,7 @@ namespace Napoleon
         if (rrank < Constants::Ranks::Int4) return bonus;
 
         Color enemy = Utils::Piece::GetOpposite(color);
-        if (pawnAttacks[color] & square_mask) // & ~pawAttacks not needed
+        if (context.attackedBy[color][Pawn] & square_mask) // & ~pawAttacks not needed
         {
             if((MoveDatabase::AttackFrontSpan[color][square] & board.Pieces(enemy, Pawn)) == 0)
             {
@@ -2,15 +2,13 @@
 
 namespace Napoleon
 {
+    const int HashEntry::NoEval = -32768;
+
     HashEntry::HashEntry()  { }
 
-    HashEntry::HashEntry(ZobristKey hash, Byte depth, Byte age, int score, Move bestMove, ScoreType bound)
+    HashEntry::HashEntry(ZobristKey hash, Byte depth, Byte age, int score, int eval, Move bestMove, ScoreType bound)
     {
-        Hash = hash;
-        Depth = depth;
-        Score = score;
-        //Bound = (bound | (age << 2));
-        Bound = bound;
-        BestMove = bestMove;
+        Data = Pack(depth, (bound | (age << 2)), 0, score, eval, bestMove);
+        Hash = hash ^ Data;
     }
 }
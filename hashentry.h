@@ -2,25 +2,90 @@
 #define HASHENTRY_H
 #include "defines.h"
 #include "move.h"
-#include <mutex>
-#include <atomic>
 
 namespace Napoleon
 {
-    enum ScoreType : Byte { Exact=0, Alpha=1, Beta=2 };
+    enum ScoreType : Byte { Exact=0, Alpha=1, Beta=2, EvalOnly=3 }; // EvalOnly: the entry only caches the static evaluation
 
+    // Lockless hash entry (Hyatt's xor trick): Hash holds zobrist key ^ Data,
+    // so an entry torn by concurrent writers fails the key check on probe.
+    //
+    // Data layout:
+    // bits  0-15: best move
+    // bits 16-31: score
+    // bits 32-47: static evaluation
+    // bits 48-55: depth
+    // bits 56-60: bound (2 bits) and age (3 bits)
+    // bits 61-63: number of threads searching the position (abdada), saturated at MaxSearching
     class HashEntry
     {
     public:
         ZobristKey Hash;
-        Byte Depth;
-        Byte Bound; // also holds age
-        Move BestMove;
-        int Score;
+        unsigned long long Data;
+
+        static const int NoEval;
+        static const int Generations = 8; // age wraps around after this many searches
+        static const int MaxSearching = 7;
+        static const int Layout = 2; // version of the data packing, tables saved with another layout are not loaded
 
         HashEntry();
-        HashEntry(ZobristKey, Byte, Byte, int, Move, ScoreType);
+        HashEntry(ZobristKey, Byte, Byte, int, int, Move, ScoreType);
+
+        ZobristKey Key() const;
+        Move BestMove() const;
+        int Score() const;
+        int Eval() const;
+        Byte Depth() const;
+        Byte Bound() const;
+        Byte Searching() const;
+
+        static unsigned long long Pack(Byte, Byte, Byte, int, int, Move);
     };
+
+    INLINE ZobristKey HashEntry::Key() const
+    {
+        return Hash ^ Data;
+    }
+
+    INLINE Move HashEntry::BestMove() const
+    {
+        return Move::Decode(Data & 0xffff);
+    }
+
+    INLINE int HashEntry::Score() const
+    {
+        return short((Data >> 16) & 0xffff);
+    }
+
+    INLINE int HashEntry::Eval() const
+    {
+        return short((Data >> 32) & 0xffff);
+    }
+
+    INLINE Byte HashEntry::Depth() const
+    {
+        return (Data >> 48) & 0xff;
+    }
+
+    INLINE Byte HashEntry::Bound() const
+    {
+        return (Data >> 56) & 0x1f;
+    }
+
+    INLINE Byte HashEntry::Searching() const
+    {
+        return Data >> 61;
+    }
+
+    INLINE unsigned long long HashEntry::Pack(Byte depth, Byte bound, Byte searching, int score, int eval, Move move)
+    {
+        return (unsigned long long)move.Encode()
+            | ((unsigned long long)(unsigned short)score << 16)
+            | ((unsigned long long)(unsigned short)eval << 32)
+            | ((unsigned long long)depth << 48)
+            | ((unsigned long long)bound << 56)
+            | ((unsigned long long)searching << 61);
+    }
 }
 
 #endif // HASHENTRY_H
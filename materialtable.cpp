@@ -0,0 +1,89 @@
+#include "materialtable.h"
+#include "board.h"
+#include "constants.h"
+#include <new>
+
+namespace Napoleon
+{
+
+    MaterialTable::MaterialTable()
+    {
+        // 1 MB: material configurations are few. Halved until the table fits in memory
+        for (entries = (1 << 20) / sizeof(MaterialEntry); entries > 0; entries /= 2)
+        {
+            table = (MaterialEntry*) Utils::Memory::AllocateLarge(entries * sizeof(MaterialEntry), pages);
+            if (table != nullptr)
+                return;
+        }
+
+        throw std::bad_alloc();
+    }
+
+    // shared by every search thread without locks: a torn entry fails the key check and is recomputed
+    MaterialEntry MaterialTable::Probe(const Board& board)
+    {
+        auto hash = at(board.materialKey);
+        MaterialEntry entry = *hash;
+
+        if (entry.Key() != board.materialKey)
+        {
+            entry.Data = compute(board);
+            entry.Hash = board.materialKey ^ entry.Data;
+            *hash = entry;
+        }
+
+        return entry;
+    }
+
+    unsigned long long MaterialTable::compute(const Board& board) const
+    {
+        using namespace PieceColor;
+        using namespace Constants::Eval;
+        using namespace Utils::Piece;
+
+        Score imbalance(0, 0);
+        Byte flags = 0;
+
+        /* PHASE-DEPENDENT piece bonus*/
+        int knights = board.NumOfPieces(White, Knight) - board.NumOfPieces(Black, Knight);
+        int rooks = board.NumOfPieces(White, Rook) - board.NumOfPieces(Black, Rook);
+        imbalance.first += KnightBonus[Opening]*knights + RookBonus[Opening]*rooks;
+        imbalance.second += KnightBonus[EndGame]*knights + RookBonus[EndGame]*rooks;
+
+        // bishop pair bonus
+        if (board.NumOfPieces(White, PieceType::Bishop) == 2)
+        {
+            imbalance.first += BishopPair[Opening];
+            imbalance.second += BishopPair[EndGame];
+        }
+
+        if (board.NumOfPieces(Black, PieceType::Bishop) == 2)
+        {
+            imbalance.first -= BishopPair[Opening];
+            imbalance.second -= BishopPair[EndGame];
+        }
+
+        // Material draw detection
+        if (board.EndGame()
+                && board.NumOfPieces(PieceType::Queen) + board.NumOfPieces(PieceType::Rook) + board.NumOfPieces(PieceType::Pawn) == 0)
+        {
+            if (board.MinorPieces() == 0) // KK
+                flags |= MaterialEntry::Drawn;
+
+            for (auto c = White; c < PieceColor::None; c++)
+            {
+                auto enemy = GetOpposite(c);
+                if (board.MinorPieces(c) == 1 && board.MinorPieces(enemy) == 0) // KN+K, KB+K
+                    flags |= MaterialEntry::Drawn;
+                if (board.NumOfPieces(c, PieceType::Knight) == 2 && board.MinorPieces(enemy) == 0) //KNN+K
+                    flags |= MaterialEntry::Drawn;
+            }
+
+            if (board.NumOfPieces(White, PieceType::Bishop) == 1 && board.NumOfPieces(Black, PieceType::Bishop) == 1)
+                flags |= MaterialEntry::BishopsDraw;
+        }
+
+        return MaterialEntry::Pack(imbalance, board.Phase(), flags);
+    }
+
+}
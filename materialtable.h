@@ -0,0 +1,93 @@
+#ifndef MATERIALTABLE_H
+#define MATERIALTABLE_H
+#include "defines.h"
+#include "utils.h"
+
+namespace Napoleon
+{
+    class Board;
+
+    // Lockless material hash entry (same xor check as HashEntry).
+    //
+    // Data layout:
+    // bits  0-15: opening imbalance
+    // bits 16-31: endgame imbalance
+    // bits 32-47: game phase
+    // bits 48-55: flags
+    class MaterialEntry
+    {
+        public:
+            static const Byte Drawn = 0x1; // no side can mate
+            static const Byte BishopsDraw = 0x2; // KB+KB: drawn when bishops run on the same color
+
+            ZobristKey Hash;
+            unsigned long long Data;
+
+            ZobristKey Key() const;
+            Score Imbalance() const;
+            int Phase() const;
+            Byte Flags() const;
+
+            static unsigned long long Pack(Score, int, Byte);
+    };
+
+    // caches everything that only depends on the number of pieces of each type
+    class MaterialTable
+    {
+        public:
+            MaterialTable();
+            MaterialEntry Probe(const Board&);
+            Utils::Memory::PageType Pages() const;
+        private:
+            MaterialEntry* table;
+            unsigned long long entries;
+            Utils::Memory::PageType pages;
+            MaterialEntry* at(ZobristKey) const;
+            unsigned long long compute(const Board&) const;
+    };
+
+    namespace Evaluation
+    {
+        extern MaterialTable materialTable;
+    }
+
+    inline ZobristKey MaterialEntry::Key() const
+    {
+        return Hash ^ Data;
+    }
+
+    inline Score MaterialEntry::Imbalance() const
+    {
+        return Score(short(Data & 0xffff), short((Data >> 16) & 0xffff));
+    }
+
+    inline int MaterialEntry::Phase() const
+    {
+        return short((Data >> 32) & 0xffff); // negative with more pieces than at the start
+    }
+
+    inline Byte MaterialEntry::Flags() const
+    {
+        return (Data >> 48) & 0xff;
+    }
+
+    inline unsigned long long MaterialEntry::Pack(Score imbalance, int phase, Byte flags)
+    {
+        return (unsigned long long)(unsigned short)imbalance.first
+            | ((unsigned long long)(unsigned short)imbalance.second << 16)
+            | ((unsigned long long)(unsigned short)phase << 32)
+            | ((unsigned long long)flags << 48);
+    }
+
+    inline Utils::Memory::PageType MaterialTable::Pages() const
+    {
+        return pages;
+    }
+
+    inline MaterialEntry* MaterialTable::at(ZobristKey key) const
+    {
+        return table + Utils::Math::MulHi(key, entries);
+    }
+}
+
+#endif // MATERIALTABLE_H
@@ -35,6 +35,9 @@ namespace Napoleon
         std::string ToAlgebraic() const;
         std::string ToSan(Board&) const;
 
+        unsigned short Encode() const;
+        static Move Decode(unsigned short);
+
     private:
         unsigned short move;
 
@@ -90,6 +93,18 @@ namespace Napoleon
         return ((move >> 12) & 0x8);
     }
 
+    inline unsigned short Move::Encode() const // raw 16 bit representation
+    {
+        return move;
+    }
+
+    inline Move Move::Decode(unsigned short encoded)
+    {
+        Move decoded;
+        decoded.move = encoded;
+        return decoded;
+    }
+
     inline bool Move::operator ==(const Move& other) const
     {
         return (move == other.move);
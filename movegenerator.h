@@ -18,24 +18,25 @@ namespace Napoleon
 {
     namespace MoveGenerator
     {
+        // kinds of moves emitted by the legal generator (captures include every promotion)
+        enum class GenType { Captures, Quiets, All };
+
         int MoveCount(Board&);
-        template<bool>
-        void GetPseudoLegalMoves(Move allMoves[],int& pos, BitBoard attackers, Board& board);
         void GetLegalMoves(Move allMoves[],int& pos, Board& board);
-        void GetAllMoves(Move allMoves[], int& pos, Board& board);
-        template<bool>
-        void GetPawnMoves(BitBoard pawns, Board& board, Move moveList[], int& pos, BitBoard target);
+        template<GenType>
+        void GetLegal(Move allMoves[], int& pos, Board& board, BitBoard checkers, BitBoard pinned);
+        template<GenType, Color>
+        void GetLegal(Move allMoves[], int& pos, Board& board, BitBoard checkers, BitBoard pinned);
+        template<Color>
+        void GetPawnMoves(BitBoard pawns, BitBoard empty, BitBoard enemy, Move moveList[], int& pos, BitBoard target);
         void GetKingMoves(BitBoard king, Board& board, Move moveList[], int& pos, BitBoard target);
         void GetKnightMoves(BitBoard knights, Board& board, Move moveList[], int& pos, BitBoard target);
         void GetRookMoves(BitBoard rooks, Board& board, Move moveList[], int& pos, BitBoard target);
         void GetBishopMoves(BitBoard bishops, Board& board, Move moveList[],int& pos, BitBoard target);
         void GetQueenMoves(BitBoard queens, Board& board, Move moveList[], int& pos, BitBoard target);
         void GetCastleMoves(Board& board, Move moveList[], int& pos);
-        template<bool>
-        void GetEvadeMoves(Board& board, BitBoard attackers, Move moveList[], int& pos);
-        void GetCaptures(Move allMoves[], int& pos, Board& board);
-        void GetCapturesAndPromotions(Move allMoves[], int& pos, Board& board);
-        void GetNonCaptures(Move allMoves[], int& pos, Board& board);
+        template<Color>
+        void GetCastleMoves(Board& board, Move moveList[], int& pos);
     }
 
     inline int MoveGenerator::MoveCount(Board& board)
@@ -46,111 +47,48 @@ namespace Napoleon
         return count;
     }
 
-    template<bool onlyCaptures>
-    INLINE void MoveGenerator::GetPseudoLegalMoves(Move allMoves[], int& pos, BitBoard attackers, Board& board)
-    {
-        if (attackers)
-        {
-            GetEvadeMoves<onlyCaptures>(board, attackers, allMoves, pos);
-            board.SetCheckState(true);
-        }
-        else if (onlyCaptures)
-        {
-            GetCapturesAndPromotions(allMoves, pos, board);
-            board.SetCheckState(false);
-        }
-        else
+    // set-wise pawn moves: every push and capture of one direction is computed at once,
+    // the direction and the promotion rank are known at compile time
+    template<Color us>
+        INLINE void MoveGenerator::GetPawnMoves(BitBoard pawns, BitBoard empty, BitBoard enemy, Move moveList[], int& pos, BitBoard target)
         {
-            GetAllMoves(allMoves, pos, board);
-            board.SetCheckState(false);
-        }
-    }
+            using namespace CompassRose;
 
-    INLINE void MoveGenerator::GetAllMoves(Move allMoves[], int& pos, Board& board)
-    {
-        GetCaptures(allMoves, pos, board);
-        GetNonCaptures(allMoves, pos, board);
-    }
+            const int up = us == PieceColor::White ? 8 : -8;
+            const BitBoard doublePushRank = us == PieceColor::White ? Constants::Ranks::Three : Constants::Ranks::Six;
+            const BitBoard lastRank = us == PieceColor::White ? Constants::Ranks::Eight : Constants::Ranks::One;
 
-    INLINE void MoveGenerator::GetCaptures(Move allMoves[], int& pos, Board& board)
-    {
-        BitBoard enemy = board.EnemyPieces();
-        GetPawnMoves<true>(board.Pieces(board.SideToMove(), PieceType::Pawn), board, allMoves, pos, enemy);
-        GetKnightMoves(board.Pieces(board.SideToMove(), PieceType::Knight), board, allMoves, pos, enemy);
-        GetBishopMoves(board.Pieces(board.SideToMove(), PieceType::Bishop), board, allMoves, pos, enemy);
-        GetQueenMoves(board.Pieces(board.SideToMove(), PieceType::Queen), board, allMoves, pos, enemy);
-        GetKingMoves(board.Pieces(board.SideToMove(), PieceType::King), board, allMoves, pos, enemy);
-        GetRookMoves(board.Pieces(board.SideToMove(), PieceType::Rook), board, allMoves, pos, enemy);
-    }
-
-    INLINE void MoveGenerator::GetCapturesAndPromotions(Move allMoves[], int& pos, Board& board)
-    {
-        BitBoard enemy = board.EnemyPieces();
-        GetPawnMoves<true>(board.Pieces(board.SideToMove(), PieceType::Pawn), board, allMoves, pos, 
-                enemy | Constants::Masks::RankMask[Utils::Square::RelativeRank(board.SideToMove(), 7)]);
-        GetKnightMoves(board.Pieces(board.SideToMove(), PieceType::Knight), board, allMoves, pos, enemy);
-        GetBishopMoves(board.Pieces(board.SideToMove(), PieceType::Bishop), board, allMoves, pos, enemy);
-        GetQueenMoves(board.Pieces(board.SideToMove(), PieceType::Queen), board, allMoves, pos, enemy);
-        GetKingMoves(board.Pieces(board.SideToMove(), PieceType::King), board, allMoves, pos, enemy);
-        GetRookMoves(board.Pieces(board.SideToMove(), PieceType::Rook), board, allMoves, pos, enemy);
-    }
+            BitBoard single = (us == PieceColor::White ? OneStepNorth(pawns) : OneStepSouth(pawns)) & empty;
+            BitBoard twice = (us == PieceColor::White ? OneStepNorth(single & doublePushRank) : OneStepSouth(single & doublePushRank)) & empty & target;
+            BitBoard east = (us == PieceColor::White ? OneStepNorthEast(pawns) : OneStepSouthEast(pawns)) & enemy & target;
+            BitBoard west = (us == PieceColor::White ? OneStepNorthWest(pawns) : OneStepSouthWest(pawns)) & enemy & target;
+            single &= target;
 
-    INLINE void MoveGenerator::GetNonCaptures(Move allMoves[], int&pos, Board& board)
-    {
-        BitBoard enemy = ~board.EnemyPieces();
-        GetPawnMoves<false>(board.Pieces(board.SideToMove(), PieceType::Pawn), board, allMoves, pos, enemy);
-        GetKnightMoves(board.Pieces(board.SideToMove(), PieceType::Knight), board, allMoves, pos, enemy);
-        GetBishopMoves(board.Pieces(board.SideToMove(), PieceType::Bishop), board, allMoves, pos, enemy);
-        GetQueenMoves(board.Pieces(board.SideToMove(), PieceType::Queen), board, allMoves, pos, enemy);
-        GetKingMoves(board.Pieces(board.SideToMove(), PieceType::King), board, allMoves, pos, enemy);
-        GetRookMoves(board.Pieces(board.SideToMove(), PieceType::Rook), board, allMoves, pos, enemy);
-        GetCastleMoves(board, allMoves, pos);
-    }
-
-    template<bool ep>
-        INLINE void MoveGenerator::GetPawnMoves(BitBoard pawns, Board& board, Move moveList[], int& pos, BitBoard target)
-        {
-            BitBoard targets;
-            BitBoard epTargets;
-            Square fromIndex;
-            Square toIndex;
-
-            while (pawns != 0)
+            auto add = [&](BitBoard targets, int delta)
             {
-                fromIndex = Utils::BitBoard::BitScanForwardReset(pawns); // search for LS1B and then reset it
-                targets = Pawn::GetAllTargets(Constants::Masks::SquareMask[fromIndex], board) & target;
-
-                if (ep)
-                {
-                    // en passant
-                    if (board.EnPassantSquare() != Constants::Squares::Invalid)
-                    {
-                        epTargets = MoveDatabase::PawnAttacks[board.SideToMove()][fromIndex];
-
-                        if ((epTargets & Constants::Masks::SquareMask[board.EnPassantSquare()]) != 0)
-                            moveList[pos++] =  Move(fromIndex, board.EnPassantSquare(), EnPassant);
-                    }
-                }
-
                 while (targets != 0)
                 {
-                    toIndex = Utils::BitBoard::BitScanForwardReset(targets); // search for LS1B and then reset it
+                    Square to = Utils::BitBoard::BitScanForwardReset(targets); // search for LS1B and then reset it
+                    Square from = to - delta;
 
-                    // promotions
-                    if ((Utils::Square::GetRankIndex(toIndex) == 7 && board.SideToMove() == PieceColor::White) ||
-                            (Utils::Square::GetRankIndex(toIndex) == 0 && board.SideToMove() == PieceColor::Black))
+                    if (Constants::Masks::SquareMask[to] & lastRank)
                     {
-                        moveList[pos++] =  Move(fromIndex, toIndex, QueenPromotion);
-                        moveList[pos++] =  Move(fromIndex, toIndex, RookPromotion);
-                        moveList[pos++] =  Move(fromIndex, toIndex, BishopPromotion);
-                        moveList[pos++] =  Move(fromIndex, toIndex, KnightPromotion);
+                        moveList[pos++] = Move(from, to, QueenPromotion);
+                        moveList[pos++] = Move(from, to, RookPromotion);
+                        moveList[pos++] = Move(from, to, BishopPromotion);
+                        moveList[pos++] = Move(from, to, KnightPromotion);
                     }
                     else
                     {
-                        moveList[pos++] =  Move(fromIndex, toIndex); // no promotions
+                        moveList[pos++] = Move(from, to);
                     }
                 }
-            }
+            };
+
+            add(east, up + 1);
+            add(west, up - 1);
+            add(single, up);
+            add(twice, 2 * up);
         }
 
     INLINE void MoveGenerator::GetKnightMoves(BitBoard knights, Board &board, Move moveList[], int& pos, BitBoard target)
@@ -232,154 +170,140 @@ namespace Napoleon
     INLINE void MoveGenerator::GetCastleMoves(Board& board, Move moveList[], int &pos)
     {
         if (board.SideToMove() == PieceColor::White)
+            GetCastleMoves<PieceColor::White>(board, moveList, pos);
+        else
+            GetCastleMoves<PieceColor::Black>(board, moveList, pos);
+    }
+
+    template<Color us>
+        INLINE void MoveGenerator::GetCastleMoves(Board& board, Move moveList[], int &pos)
         {
-            if (board.CastlingStatus() & Constants::Castle::WhiteCastleOO)
-            {
-                if ((Constants::Castle::WhiteCastleMaskOO & board.OccupiedSquares) == 0)
-                {
-                    if (board.KingSquare(PieceColor::White) == Constants::Squares::E1 &&
-                        !board.IsAttacked(Constants::Castle::WhiteCastleMaskOO, board.SideToMove()))
-                        moveList[pos++] =  Constants::Castle::WhiteCastlingOO;
-                }
+            using namespace Constants::Castle;
 
-            }
-            if (board.CastlingStatus() & Constants::Castle::WhiteCastleOOO)
-            {
-                if ((Constants::Castle::WhiteCastleMaskOOO & board.OccupiedSquares) == 0)
-                {
-                    if (board.KingSquare(PieceColor::White) == Constants::Squares::E1 &&
-                        !board.IsAttacked(Constants::Castle::WhiteCastleMaskOOO 
-                          ^ Constants::Squares::B1, board.SideToMove()))
-                        moveList[pos++] =  Constants::Castle::WhiteCastlingOOO;
-                }
-            }
+            const Byte rightsOO = us == PieceColor::White ? WhiteCastleOO : BlackCastleOO;
+            const Byte rightsOOO = us == PieceColor::White ? WhiteCastleOOO : BlackCastleOOO;
+            const BitBoard maskOO = us == PieceColor::White ? WhiteCastleMaskOO : BlackCastleMaskOO;
+            const BitBoard maskOOO = us == PieceColor::White ? WhiteCastleMaskOOO : BlackCastleMaskOOO;
+            const BitBoard rookPath = us == PieceColor::White ? Constants::Squares::B1 : Constants::Squares::B8; // may be attacked
+            const Square kingSquare = us == PieceColor::White ? Constants::Squares::IntE1 : Constants::Squares::IntE8;
+
+            if (board.KingSquare(us) != kingSquare)
+                return;
+
+            if ((board.CastlingStatus() & rightsOO) && (maskOO & board.OccupiedSquares) == 0
+                    && !board.IsAttacked(maskOO, us))
+                moveList[pos++] = us == PieceColor::White ? WhiteCastlingOO : BlackCastlingOO;
+
+            if ((board.CastlingStatus() & rightsOOO) && (maskOOO & board.OccupiedSquares) == 0
+                    && !board.IsAttacked(maskOOO ^ rookPath, us))
+                moveList[pos++] = us == PieceColor::White ? WhiteCastlingOOO : BlackCastlingOOO;
         }
 
-        else if (board.SideToMove() == PieceColor::Black)
+
+    INLINE void MoveGenerator::GetLegalMoves(Move allMoves[],int& pos, Board& board)
+    {
+        GetLegal<GenType::All>(allMoves, pos, board,
+                board.KingAttackers(board.KingSquare(board.SideToMove()), board.SideToMove()), board.PinnedPieces());
+    }
+
+    // generate only legal moves. Checkers and pinned pieces are computed once by the caller:
+    // in check the other pieces may only capture the checker or block it,
+    // pinned pieces may only move along the line of their king
+    template<MoveGenerator::GenType type>
+        INLINE void MoveGenerator::GetLegal(Move allMoves[], int& pos, Board& board, BitBoard checkers, BitBoard pinned)
         {
-            if (board.CastlingStatus() & Constants::Castle::BlackCastleOO)
-            {
-                if ((Constants::Castle::BlackCastleMaskOO & board.OccupiedSquares) == 0)
-                {
-                    if (board.KingSquare(PieceColor::Black) == Constants::Squares::E8 &&
-                        !board.IsAttacked(Constants::Castle::BlackCastleMaskOO, board.SideToMove()))
-                        moveList[pos++] =  Constants::Castle::BlackCastlingOO;
-                }
-            }
-            if (board.CastlingStatus() & Constants::Castle::BlackCastleOOO)
-            {
-                if ((Constants::Castle::BlackCastleMaskOOO & board.OccupiedSquares) == 0)
-                {
-                    if (board.KingSquare(PieceColor::Black) == Constants::Squares::E8 &&
-                        !board.IsAttacked(Constants::Castle::BlackCastleMaskOOO^ Constants::Squares::B8, board.SideToMove()))
-                        moveList[pos++] =  Constants::Castle::BlackCastlingOOO;
-                }
-            }
+            if (board.SideToMove() == PieceColor::White)
+                GetLegal<type, PieceColor::White>(allMoves, pos, board, checkers, pinned);
+            else
+                GetLegal<type, PieceColor::Black>(allMoves, pos, board, checkers, pinned);
         }
-    }
 
-    //thanks stockfish for this
-    template<bool onlyCaptures>
-        void MoveGenerator::GetEvadeMoves(Board& board, BitBoard checkers, Move moveList[], int& pos)
+    template<MoveGenerator::GenType type, Color us>
+        INLINE void MoveGenerator::GetLegal(Move allMoves[], int& pos, Board& board, BitBoard checkers, BitBoard pinned)
         {
-            BitBoard b;
-            Square to;
-            Square from, checksq;
-            Square ksq = board.KingSquare(board.SideToMove());
-            int checkersCnt = 0;
-            BitBoard sliderAttacks = 0;
-
-            // Find squares attacked by slider checkers, we will remove them from the king
-            // evasions so to skip known illegal moves avoiding useless legality check later.
-            b = checkers;
-            do
-            {
-                checkersCnt++;
-                checksq = Utils::BitBoard::BitScanForwardReset(b);
+            using namespace Constants::Masks;
 
-                switch (board.PieceOnSquare(checksq).Type)
-                {
-                    case PieceType::Bishop: sliderAttacks |= MoveDatabase::PseudoBishopAttacks[checksq]; break;
-                    case PieceType::Rook: sliderAttacks |= MoveDatabase::PseudoRookAttacks[checksq]; break;
-                    case PieceType::Queen:
-                                          // If queen and king are far or not on a diagonal line we can safely
-                                          // remove all the squares attacked in the other direction becuase are
-                                          // not reachable by the king anyway.
-                                          if ( MoveDatabase::ObstructedTable[ksq][checksq] || (MoveDatabase::PseudoBishopAttacks[checksq] & Constants::Masks::SquareMask[ksq])==0)
-                                              sliderAttacks |=  MoveDatabase::PseudoBishopAttacks[checksq]
-                                                  | MoveDatabase::PseudoRookAttacks[checksq];
-
-                                          // Otherwise we need to use real rook attacks to check if king is safe
-                                          // to move in the other direction. For example: king in B2, queen in A1
-                                          // a knight in B1, and we can safely move to C1.
-                                          else
-                                              sliderAttacks |= MoveDatabase::PseudoBishopAttacks[checksq] | MoveDatabase::GetRookAttacks(board.OccupiedSquares, checksq);
-                                          break;
-
-                    default:
-                                          break;
-                }
-            } while (b);
+            const Color them = us == PieceColor::White ? PieceColor::Black : PieceColor::White;
+            const BitBoard lastRank = us == PieceColor::White ? Constants::Ranks::Eight : Constants::Ranks::One;
+            Square ksq = board.KingSquare(us);
+            BitBoard enemy = board.Pieces(them);
+            BitBoard empty = board.EmptySquares;
+            BitBoard target, pawnTarget, b;
+            Square from, to;
 
-            // Generate evasions for king, capture and non capture moves
-            if (onlyCaptures)
-                b = MoveDatabase::KingAttacks[ksq] & checkers;
-            else
-                b = MoveDatabase::KingAttacks[ksq] & ~board.PlayerPieces() & ~sliderAttacks;
+            switch (type)
+            {
+                case GenType::Captures: target = enemy; pawnTarget = enemy | (empty & lastRank); break;
+                case GenType::Quiets: target = empty; pawnTarget = empty & ~lastRank; break;
+                default: target = pawnTarget = enemy | empty; break;
+            }
 
-            from = ksq;
+            // the king must not land on a square attacked through its own square
+            BitBoard occupancy = board.OccupiedSquares ^ SquareMask[ksq];
+            b = MoveDatabase::KingAttacks[ksq] & target;
 
             while (b)
             {
-                to = Utils::BitBoard::BitScanForwardReset(b); // search for LS1B and then reset it
-                moveList[pos++] = Move(from, to);
+                to = Utils::BitBoard::BitScanForwardReset(b);
+                if (!board.AttacksTo(to, them, occupancy))
+                    allMoves[pos++] = Move(ksq, to);
             }
 
-            // Generate evasions for other pieces only if not under a double check
-            if (checkersCnt > 1)
+            if (checkers & (checkers - 1)) // double check: only the king can move
                 return;
 
-            // Blocking evasions or captures of the checking piece
-            BitBoard target;
-
-            if (onlyCaptures)
-                target = checkers;
-            else
-                target = MoveDatabase::ObstructedTable[checksq][ksq] | checkers;
-
-            GetPawnMoves<true>(board.Pieces(board.SideToMove(), PieceType::Pawn), board, moveList, pos, target);
-            GetKnightMoves(board.Pieces(board.SideToMove(), PieceType::Knight), board, moveList, pos, target);
-            GetBishopMoves(board.Pieces(board.SideToMove(), PieceType::Bishop), board, moveList, pos, target);
-            GetRookMoves(board.Pieces(board.SideToMove(), PieceType::Rook), board, moveList, pos, target);
-            GetQueenMoves(board.Pieces(board.SideToMove(), PieceType::Queen), board, moveList, pos, target);
-        }
-
+            if (checkers)
+            {
+                BitBoard evasions = MoveDatabase::ObstructedTable[Utils::BitBoard::BitScanForward(checkers)][ksq] | checkers;
+                target &= evasions;
+                pawnTarget &= evasions;
+            }
+            else if (type != GenType::Captures)
+            {
+                GetCastleMoves<us>(board, allMoves, pos);
+            }
 
-    INLINE void MoveGenerator::GetLegalMoves(Move allMoves[],int& pos, Board& board)
-    {
-        BitBoard pinned = board.PinnedPieces();
-        BitBoard attackers = board.KingAttackers(board.KingSquare(board.SideToMove()), board.SideToMove());
+            int first = pos;
 
-        if (attackers)
-            GetEvadeMoves<false>(board, attackers, allMoves, pos);
-        else
-            GetAllMoves(allMoves, pos, board);
+            GetPawnMoves<us>(board.Pieces(us, PieceType::Pawn), empty, enemy, allMoves, pos, pawnTarget);
+            GetKnightMoves(board.Pieces(us, PieceType::Knight) & ~pinned, board, allMoves, pos, target); // pinned knights never move
+            GetBishopMoves(board.Pieces(us, PieceType::Bishop), board, allMoves, pos, target);
+            GetQueenMoves(board.Pieces(us, PieceType::Queen), board, allMoves, pos, target);
+            GetRookMoves(board.Pieces(us, PieceType::Rook), board, allMoves, pos, target);
 
-        int last = pos;
-        int cur = 0;
-        while (cur != last)
-        {
-            if (!board.IsMoveLegal(allMoves[cur], pinned))
+            if (pinned)
             {
-                allMoves[cur] = allMoves[--last];
+                int last = pos;
+                int cur = first;
+                while (cur != last)
+                {
+                    from = allMoves[cur].FromSquare();
+
+                    if ((pinned & SquareMask[from]) && !MoveDatabase::AreSquareAligned(from, allMoves[cur].ToSquare(), ksq))
+                        allMoves[cur] = allMoves[--last];
+                    else
+                        cur++;
+                }
+                pos = last;
             }
-            else
+
+            // en passant: look for sliders behind both the pawns once they have left the board
+            if (type != GenType::Quiets && board.EnPassantSquare() != Constants::Squares::Invalid)
             {
-                cur++;
+                Square ep = board.EnPassantSquare();
+                Square captured = us == PieceColor::White ? ep - 8 : ep + 8;
+                b = MoveDatabase::PawnAttacks[them][ep] & board.Pieces(us, PieceType::Pawn);
+
+                while (b)
+                {
+                    from = Utils::BitBoard::BitScanForwardReset(b);
+                    occupancy = board.OccupiedSquares ^ SquareMask[from] ^ SquareMask[ep] ^ SquareMask[captured];
+
+                    if ((board.AttacksTo(ksq, them, occupancy) & ~SquareMask[captured]) == 0)
+                        allMoves[pos++] = Move(from, ep, EnPassant);
+                }
             }
         }
-        pos = last;
-    }
 
 }
 #endif // MOVEGENERATOR_H
@@ -3,9 +3,19 @@
 namespace Napoleon
 {
 
-    MoveSelector::MoveSelector(Board& board, SearchInfo& info) : board(board), hashMove(Constants::NullMove), count(0), info(info), first(0)
+    MoveSelector::MoveSelector(Board& board, SearchInfo& info) : board(board), hashMove(Constants::NullMove), count(0), info(info),
+        stage(Stage::Sorted), checkers(0), pinned(0), ply(0), first(0), badCaptures(0), killer(0), deferredCount(0), deferredIndex(0)
     {
 
     }
 
+    // staged selector of the main search: legal moves are generated on demand
+    MoveSelector::MoveSelector(Board& board, SearchInfo& info, Move hashMove, int ply, BitBoard checkers) : board(board), hashMove(hashMove), count(0),
+        info(info), stage(Stage::HashMove), checkers(checkers), pinned(board.PinnedPieces()), ply(ply), first(0), badCaptures(0), killer(0), deferredCount(0), deferredIndex(0)
+    {
+        killers[0] = info.FirstKiller(ply);
+        killers[1] = info.SecondKiller(ply);
+        board.SetCheckState(checkers != 0);
+    }
+
 }
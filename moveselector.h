@@ -3,10 +3,30 @@
 #include "constants.h"
 #include "board.h"
 #include "move.h"
+#include "movegenerator.h"
 #include "searchinfo.h"
 
 namespace Napoleon
 {
+    // move picking stages. Moves supplied by the caller are only sorted (root and quiescence),
+    // otherwise they are generated stage by stage, so that a cutoff on the hash move or on
+    // a capture skips the generation and the ordering of every quiet move
+    enum class Stage
+    {
+        Sorted,
+        HashMove,
+        GenerateCaptures,
+        GoodCaptures,
+        Killers,
+        GenerateQuiets,
+        Quiets,
+        BadCaptures,
+        GenerateEvasions,
+        Evasions,
+        Deferred,
+        Done
+    };
+
     class MoveSelector
     {
     public:
@@ -16,20 +36,40 @@ namespace Napoleon
         int count;
 
         MoveSelector(Board&, SearchInfo&);
+        MoveSelector(Board&, SearchInfo&, Move, int, BitBoard);
 
         template<bool>
         void Sort(int = 0);
 
         Move First();
         Move Next();
+        Move Next(Board&, SearchInfo&);
         void Reset();
+        void Defer(Move);
+        bool Revisiting() const;
         Move& operator[](int);
 
     private:
+        Move pick();
+        void scoreCaptures(Board&);
+        void scoreQuiets(Board&, SearchInfo&);
+        template<bool>
+        void score(Board&, SearchInfo&, int);
+
         int scores[Constants::MaxMoves];
+        Move killers[2];
+        Move deferredMoves[Constants::MaxMoves];
 
         SearchInfo& info;
+        Stage stage;
+        BitBoard checkers;
+        BitBoard pinned;
+        int ply;
         int first;
+        int badCaptures; // number of losing captures, stored at the front of the move array
+        int killer; // next killer to try
+        int deferredCount;
+        int deferredIndex;
     };
 
     inline Move& MoveSelector::operator[](int index)
@@ -39,19 +79,7 @@ namespace Napoleon
 
     inline Move MoveSelector::First()
     {
-        /*
-         * TODO: TRY THIS
-        if (!hashMove.IsNull())
-        {
-            for(int i=0; i<count; i++) // do not trust hashMove (may be an illegal move)
-            {
-                if (moves[i] == hashMove) return hashMove;
-            }
-        }
-        return Next();
-        */
-
-        if (!hashMove.IsNull())
+        if (stage == Stage::Sorted && !hashMove.IsNull())
             return hashMove;
         else
             return Next();
@@ -62,20 +90,27 @@ namespace Napoleon
         first = 0;
     }
 
-    // make a selection sort on the move array for picking the best untried move
-    inline Move MoveSelector::Next()
+    // postpone an already selected move, so that it is selected again
+    // after every other move (abdada deferred moves)
+    inline void MoveSelector::Defer(Move move)
     {
+        assert(deferredCount < Constants::MaxMoves);
+        deferredMoves[deferredCount++] = move;
+    }
 
-        if (first == -1)
-            return First();
+    // true if the last selected move had been deferred
+    inline bool MoveSelector::Revisiting() const
+    {
+        return stage == Stage::Deferred;
+    }
 
+    // make a selection sort step on the move array for picking the best untried move
+    inline Move MoveSelector::pick()
+    {
         int max = first;
 
-        if (max >= count)
-            return Constants::NullMove;
-
         for (auto i=first+1; i<count; i++)
-            if (scores[i] > scores[max] /*&& moves[i] != hashMove*/)
+            if (scores[i] > scores[max])
                 max = i;
 
         if (max != first)
@@ -84,12 +119,160 @@ namespace Napoleon
             std::swap(scores[first], scores[max]);
         }
 
-        Move move = moves[first++];
+        return moves[first++];
+    }
 
-        if (move != hashMove)
-            return move;
-        else
-            return Next();
+    inline Move MoveSelector::Next()
+    {
+        return Next(board, info);
+    }
+
+    // pick the next move, generating it on the given position if needed. Threads sharing
+    // a split point pass their own copy of the position, since the owner keeps searching on its board,
+    // and their own search info, since the owner keeps updating its history
+    inline Move MoveSelector::Next(Board& position, SearchInfo& threadInfo)
+    {
+        Move move;
+
+        while (true)
+        {
+            switch (stage)
+            {
+                case Stage::Sorted:
+                    while (first < count)
+                        if ((move = pick()) != hashMove)
+                            return move;
+
+                    stage = Stage::Deferred;
+                    break;
+
+                case Stage::HashMove:
+                    stage = checkers ? Stage::GenerateEvasions : Stage::GenerateCaptures;
+
+                    // the hash move may come from another position (key collision)
+                    if (position.IsPseudoLegal(hashMove) && position.IsMoveLegal(hashMove, pinned))
+                        return hashMove;
+
+                    hashMove = Constants::NullMove;
+                    break;
+
+                case Stage::GenerateCaptures:
+                    MoveGenerator::GetLegal<MoveGenerator::GenType::Captures>(moves, count, position, checkers, pinned);
+                    scoreCaptures(position);
+                    stage = Stage::GoodCaptures;
+                    break;
+
+                case Stage::GoodCaptures:
+                    while (first < count)
+                    {
+                        move = pick();
+
+                        if (move == hashMove)
+                            continue;
+
+                        // a more valuable piece takes: postpone the capture if it loses material
+                        if (scores[first - 1] < 0 && position.See(move) < 0)
+                        {
+                            moves[badCaptures++] = move;
+                            continue;
+                        }
+
+                        return move;
+                    }
+
+                    stage = Stage::Killers;
+                    break;
+
+                // killers come from sibling nodes: captures and promotions have already been tried
+                case Stage::Killers:
+                    while (killer < 2)
+                    {
+                        move = killers[killer];
+
+                        if (move != hashMove
+                                && (killer == 0 || move != killers[0])
+                                && !move.IsPromotion()
+                                && !position.IsCapture(move)
+                                && position.IsPseudoLegal(move)
+                                && position.IsMoveLegal(move, pinned))
+                            return killers[killer++];
+
+                        killers[killer++] = Constants::NullMove;
+                    }
+
+                    stage = Stage::GenerateQuiets;
+                    break;
+
+                case Stage::GenerateQuiets:
+                    first = count;
+                    MoveGenerator::GetLegal<MoveGenerator::GenType::Quiets>(moves, count, position, checkers, pinned);
+                    scoreQuiets(position, threadInfo);
+                    stage = Stage::Quiets;
+                    break;
+
+                case Stage::Quiets:
+                    while (first < count)
+                        if ((move = pick()) != hashMove && move != killers[0] && move != killers[1])
+                            return move;
+
+                    first = 0;
+                    stage = Stage::BadCaptures;
+                    break;
+
+                case Stage::BadCaptures:
+                    if (first < badCaptures)
+                        return moves[first++];
+
+                    stage = Stage::Deferred;
+                    break;
+
+                case Stage::GenerateEvasions:
+                    MoveGenerator::GetLegal<MoveGenerator::GenType::All>(moves, count, position, checkers, pinned);
+                    score<false>(position, threadInfo, ply);
+                    stage = Stage::Evasions;
+                    break;
+
+                case Stage::Evasions:
+                    while (first < count)
+                        if ((move = pick()) != hashMove)
+                            return move;
+
+                    stage = Stage::Deferred;
+                    break;
+
+                case Stage::Deferred:
+                    if (deferredIndex < deferredCount)
+                        return deferredMoves[deferredIndex++];
+
+                    stage = Stage::Done;
+                    break;
+
+                default:
+                    return Constants::NullMove;
+            }
+        }
+    }
+
+    // most valuable victim, least valuable attacker. Promotions come first
+    inline void MoveSelector::scoreCaptures(Board& board)
+    {
+        using namespace Constants::Piece;
+
+        for (auto i=first; i<count; i++)
+        {
+            Type captured = moves[i].IsEnPassant() ? Type(PieceType::Pawn) : board.PieceOnSquare(moves[i].ToSquare()).Type;
+
+            if (moves[i].IsPromotion())
+                scores[i] = PieceValue[moves[i].PiecePromoted()] + (captured != PieceType::None ? PieceValue[captured] : 0);
+            else
+                scores[i] = PieceValue[captured] - PieceValue[board.PieceOnSquare(moves[i].FromSquare()).Type];
+        }
+    }
+
+    inline void MoveSelector::scoreQuiets(Board& board, SearchInfo& threadInfo)
+    {
+        for (auto i=first; i<count; i++)
+            scores[i] = threadInfo.HistoryScore(moves[i], board.SideToMove());
     }
 
     /// set scores for sorting moves
@@ -112,6 +295,12 @@ namespace Napoleon
 
     template<bool quiesce>
         void MoveSelector::Sort(int ply)
+        {
+            score<quiesce>(board, info, ply);
+        }
+
+    template<bool quiesce>
+        void MoveSelector::score(Board& board, SearchInfo& threadInfo, int ply)
         {
             using namespace Constants::Piece;
 
@@ -138,19 +327,19 @@ namespace Napoleon
                     }
                 }
 
-                else if (moves[i] == info.FirstKiller(ply))
+                else if (moves[i] == threadInfo.FirstKiller(ply))
                     scores[i] = - 1;
-                else if (moves[i] == info.SecondKiller(ply))
+                else if (moves[i] == threadInfo.SecondKiller(ply))
                     scores[i] = - 2;
 
-                else if ((historyScore = info.HistoryScore(moves[i], board.SideToMove())) > max)
+                else if ((historyScore = threadInfo.HistoryScore(moves[i], board.SideToMove())) > max)
                     max = historyScore;
             }
 
             for (auto i=0; i<count; i++)
             {
-                if (!board.IsCapture(moves[i]) && moves[i] != info.FirstKiller(ply) && moves[i] != info.SecondKiller(ply))
-                    scores[i] = info.HistoryScore(moves[i], board.SideToMove()) - max - 3;
+                if (!board.IsCapture(moves[i]) && moves[i] != threadInfo.FirstKiller(ply) && moves[i] != threadInfo.SecondKiller(ply))
+                    scores[i] = threadInfo.HistoryScore(moves[i], board.SideToMove()) - max - 3;
             }
         }
 
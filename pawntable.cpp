@@ -1,55 +1,40 @@
 #include "pawntable.h"
 #include "utils.h"
+#include <new>
 
 namespace Napoleon
 {
 
     PawnTable::PawnTable()
     {
-        entries = ((64*std::pow(2, 20)) / sizeof(PawnEntry)); // number of bytes * size of HashEntry = number of entries
-        entries = std::pow(2, Utils::Math::Log2(entries));
-        lock_entries = entries;
-        free(table);
-        free(locks);
-        table = (PawnEntry*) std::calloc(entries * sizeof(PawnEntry), 1);
-        locks = new SpinLock[lock_entries];
-        mask = entries - 1;
+        // number of bytes / size of PawnEntry = number of entries, halved until the table fits in memory
+        for (entries = ((64*std::pow(2, 20)) / sizeof(PawnEntry)); entries > 0; entries /= 2)
+        {
+            table = (PawnEntry*) Utils::Memory::AllocateLarge(entries * sizeof(PawnEntry), pages);
+            if (table != nullptr)
+                return;
+        }
+
+        throw std::bad_alloc();
     }
 
-    PawnEntry* PawnTable::at(ZobristKey key) const
+    Utils::Memory::PageType PawnTable::Pages() const
     {
-        return table + (key & mask);
+        return pages;
     }
 
-    void PawnTable::Save(ZobristKey key, Score score)
+    // the table is shared by every search thread without locks (see PawnEntry)
+    void PawnTable::Save(ZobristKey key, PawnEntry& entry)
     {
-        SpinLock* mux = locks + (key & mask);
-
-        if (Concurrent)
-            mux->lock();
-
-        auto hash = at(key);
-        hash->key = key;
-        hash->score = score;
-
-        mux->unlock();
+        entry.key = key ^ entry.Data();
+        *at(key) = entry;
     }
 
-    Score PawnTable::Probe(ZobristKey key)
+    // entry is set to a local copy of the stored entry, valid only if true is returned
+    bool PawnTable::Probe(ZobristKey key, PawnEntry& entry) const
     {
-        SpinLock* mux = locks + (key & mask);
-
-        if (Concurrent)
-            mux->lock();
-
-        auto hash = at(key);
-        if (hash->key == key)
-        {
-            return hash->score;
-        }
-
-        mux->unlock();
-        return Score(TranspositionTable::Unknown, TranspositionTable::Unknown);
+        entry = *at(key);
+        return entry.Key() == key;
     }
 
 }
@@ -3,6 +3,8 @@
 
 namespace Napoleon
 {
+    // Lockless pawn hash entry: like HashEntry, key holds the pawn key xor-ed
+    // with every data word, so an entry torn by concurrent writers fails the key check
     class PawnEntry
     {
         public:
@@ -10,22 +12,60 @@ namespace Napoleon
             Score score;
             BitBoard attacks[2]; // color
             //BitBoard passers[2]; // holds (candidate) passers positions for both colors
+            Score shelter[2][2]; // color, wing (queen side, king side)
+            Byte halfOpenFiles[2]; // color, one bit for each file without own pawns
+
+            ZobristKey Key() const;
+            unsigned long long Data() const;
+
+        private:
+            static unsigned long long pack(Score);
     };
 
     class PawnTable 
     {
         public:
             PawnTable();
-            void Save(ZobristKey, Score);
-            Score Probe(ZobristKey);
-            PawnEntry* at(ZobristKey) const;
-            bool Concurrent = false;
+            void Save(ZobristKey, PawnEntry&);
+            bool Probe(ZobristKey, PawnEntry&) const;
+            void Prefetch(ZobristKey) const;
+            Utils::Memory::PageType Pages() const;
         private:
             PawnEntry* table;
-            SpinLock* locks;
-            unsigned long long mask;
             unsigned long long entries;
-            unsigned long lock_entries;
+            Utils::Memory::PageType pages;
+            PawnEntry* at(ZobristKey) const;
     };
 
+    inline ZobristKey PawnEntry::Key() const
+    {
+        return key ^ Data();
+    }
+
+    inline unsigned long long PawnEntry::Data() const
+    {
+        using namespace PieceColor;
+
+        return pack(score)
+            ^ attacks[White] ^ attacks[Black]
+            ^ pack(shelter[White][0]) ^ pack(shelter[White][1])
+            ^ pack(shelter[Black][0]) ^ pack(shelter[Black][1])
+            ^ (halfOpenFiles[White] | halfOpenFiles[Black] << 8);
+    }
+
+    inline unsigned long long PawnEntry::pack(Score score)
+    {
+        return (unsigned long long)(unsigned)score.first << 32 | (unsigned)score.second;
+    }
+
+    inline PawnEntry* PawnTable::at(ZobristKey key) const
+    {
+        return table + Utils::Math::MulHi(key, entries);
+    }
+
+    inline void PawnTable::Prefetch(ZobristKey key) const
+    {
+        Utils::Memory::Prefetch(at(key));
+    }
+
 }
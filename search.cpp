@@ -9,10 +9,9 @@
 #include <cstdio>
 #include <sstream>
 #include <algorithm>
-#include <functional>
-#include <random>
-
-//TODO templatize random generator
+#include <memory>
+#include <deque>
+#include <chrono>
 
 namespace Napoleon
 {
@@ -27,17 +26,62 @@ namespace Napoleon
 
     thread_local bool Search::sendOutput = false;
     thread_local SearchInfo Search::searchInfo;
+    thread_local EvalContext Search::evalContext;
     std::vector<std::thread> Search::threads;
-    ParallelInfo Search::parallelInfo;
+    std::vector<ThreadResult> Search::results(1);
     std::condition_variable Search::parallel;
+    std::condition_variable helpersDone;
     std::mutex mux;
 
+    Board rootPosition; // position shared with helper threads (guarded by mux)
+    int searchId = 0; // incremented every time helpers are woken up
+    int activeHelpers = 0;
+
+    // young brothers wait state (guarded by mux)
+    ParallelMode Search::parallelMode = ParallelMode::LazySMP;
+    const int Search::MinSplitDepth = 4;
+    thread_local SplitPoint* Search::activeSplit = nullptr;
+    std::vector<SplitPoint*> assigned(1); // thread id
+    std::vector<Board> splitBoard(1); // thread id
+    std::vector<Board*> receiver(1); // thread id, where an idle thread gets the split position
+    std::vector<SplitPoint*> waiting(1, nullptr); // thread id, split point an idle master is waiting for
+    std::vector<bool> idle(1, false); // thread id
+    std::atomic<int> idleThreads(0); // read without the lock before trying to split
+    thread_local std::deque<Board> waitBoard; // positions of the split points joined by a waiting master
+    thread_local int waitLevel = 0; // waitBoard entries in use
+    thread_local int infoAge = -1; // search of the helper's history and killers
+
+    // abdada
+    const int Search::MinDeferDepth = 3;
+    const int Search::Deferred = -Constants::Unknown; // returned by searchMove for deferred moves
+
+    // lazy smp depth skipping schedule (indexed by helper id)
+    const int SkipSize[] = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+    const int SkipPhase[] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
     int Search::depth_limit = 100;
-    int Search::cores;
+    int Search::cores = 1;
     const int Search::default_cores = 1;
-    int Age = 0;
+    int Search::Age = 0;
+
+    // nodes searched by every thread during the current search. Each counter is only
+    // written by its own thread. new[] only aligns the array to 16 bytes, so counters are
+    // padded to two cache lines: no two of them can share one, wherever the array starts
+    class NodeCounter
+    {
+        public:
+            std::atomic<unsigned long> nodes;
+            char padding[128 - sizeof(std::atomic<unsigned long>)];
+    };
+    std::unique_ptr<NodeCounter[]> nodeCount(new NodeCounter[1]());
+    thread_local int threadId = 0;
+
+    inline void countNode()
+    {
+        auto& nodes = nodeCount[threadId].nodes;
+        nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
 
-    std::atomic<unsigned long> node_count(0);
     std::ofstream* Search::positions_dataset;
     bool Search::record_positions = false;
 
@@ -62,6 +106,21 @@ namespace Napoleon
         return gameTime / 30 - (gameTime / (60 * 1000));
     }
 
+    // raise StopSignal when the time is over, switch to the game time on a ponder hit.
+    // Only called by the thread sending the output, which owns the clock
+    void Search::checkTime(Board& board)
+    {
+        if (searchInfo.TimeOver())
+            StopSignal = true;
+
+        if(PonderHit && pondering)
+        {
+            searchInfo.SetGameTime(predictTime(board.SideToMove()));
+            PonderHit = false;
+            pondering = false;
+        }
+    }
+
     // direct interface to the client.
     // it sends the move to the uci gui
     Move Search::StartThinking(SearchType type, Board& board, bool verbose, bool san)
@@ -99,7 +158,32 @@ namespace Napoleon
             searchInfo.NewSearch(time);
         }
 
+        Age = (Age + 1) % HashEntry::Generations;
+        for (int i=0; i<cores; i++)
+            nodeCount[i].nodes = 0;
+
+        startHelpers(board);
         Move move = iterativeSearch(board);
+        waitHelpers();
+
+        // let the thread which completed the deepest iteration supply the bestmove
+        int best = 0;
+        for (int i=1; i<cores; i++)
+        {
+            if (results[i].move.IsNull())
+                continue;
+
+            if (results[i].depth > results[best].depth
+                    || (results[i].depth == results[best].depth && results[i].score > results[best].score))
+                best = i;
+        }
+
+        if (best != 0)
+        {
+            move = results[best].move;
+            if (sendOutput)
+                Uci::SendCommand<Command::Info>(GetInfo(board, move, results[best].score, results[best].depth, results[best].seldepth));
+        }
 
         if (sendOutput && !move.IsNull())
         {
@@ -132,12 +216,14 @@ namespace Napoleon
     void Search::StopThinking()
     {
         StopSignal = true;
-        parallelInfo.SetReady(false);
     }
 
     void Search::KillThreads()
     {
-        quit = true;
+        {
+            std::lock_guard<std::mutex> lock(mux);
+            quit = true;
+        }
         parallel.notify_all();
         for (auto& t: threads)
             t.join();
@@ -147,67 +233,263 @@ namespace Napoleon
 
     void Search::InitializeThreads(int threads_number)
     {
-        Table.Concurrent = threads_number > 1;
-        Evaluation::pawnTable.Concurrent = threads_number > 1;
-        if (threads_number == cores) return; // nothing to do 
+        if (threads_number == cores && threads.size() == unsigned(cores - 1)) return; // nothing to do 
 
         KillThreads();
-        {
-            std::lock_guard<std::mutex> lock(mux);
-            parallelInfo.SetReady(false);
-        }
         cores=threads_number;
+        results.assign(cores, ThreadResult());
+        nodeCount.reset(new NodeCounter[cores]());
+        assigned.assign(cores, nullptr);
+        splitBoard.resize(cores);
+        receiver.assign(cores, nullptr);
+        waiting.assign(cores, nullptr);
+        idle.assign(cores, false);
+        idleThreads = 0;
         for (int i=1; i<cores; i++)
-            threads.push_back(std::thread(parallelSearch));
+            setIdle(i, &splitBoard[i], nullptr);
+        for (int i=1; i<cores; i++)
+            threads.push_back(std::thread(parallelSearch, i));
     }
 
-    void Search::signalThreads(int depth, int alpha, int beta, const Board& board, bool ready)
+    // hand the root position to every helper thread and wake them up
+    void Search::startHelpers(const Board& board)
     {
-        std::unique_lock<std::mutex> lock(mux);
-        parallelInfo.UpdateInfo(depth, alpha, beta, board, ready);
-        lock.unlock();
+        for (auto& result : results)
+            result = ThreadResult { Constants::NullMove, -Constants::Infinity, 0, 0 };
+
+        // young brothers wait helpers only receive work from split points
+        if (cores <= 1 || parallelMode == ParallelMode::YBWC)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mux);
+            rootPosition = board;
+            activeHelpers = cores - 1;
+            searchId++;
+        }
         parallel.notify_all();
     }
 
-    void Search::parallelSearch()
+    // helpers only stop when StopSignal is raised (or their depth limit is reached)
+    void Search::waitHelpers()
     {
-        std::default_random_engine eng;
-        std::uniform_int_distribution<int> score_dist(0, 25); // to tune
-        std::uniform_int_distribution<int> depth_dist(0, 0); // to tune
+        std::unique_lock<std::mutex> lock(mux);
+        helpersDone.wait(lock, []{ return activeHelpers == 0; });
+    }
 
-        /* thread local information */
+    // helper thread main loop.
+    // lazy smp: every helper runs its own iterative deepening loop on
+    // a private copy of the root position. The only shared state is the transposition table.
+    // young brothers wait: helpers sleep until a master assigns them a split point.
+    void Search::parallelSearch(int id)
+    {
+        int lastSearch = searchId;
+        threadId = id;
         sendOutput = false;
         searchInfo.NewSearch();
 
-        Move* move = new Move();
-        Board* board = new Board();
-        while(!quit)
+        while(true)
         {
             std::unique_lock<std::mutex> lock(mux);
-            parallel.wait(lock, []{return quit || parallelInfo.Ready();});
-            auto info = parallelInfo;
+            parallel.wait(lock, [&]{ return quit || searchId != lastSearch || assigned[id] != nullptr; });
+            if (quit) break;
+
+            if (assigned[id] != nullptr)
+            {
+                lock.unlock();
+                helpSplitPoint(id);
+
+                lock.lock();
+                setIdle(id, &splitBoard[id], nullptr);
+                lock.unlock();
+                continue;
+            }
+
+            lastSearch = searchId;
+            Board board(rootPosition);
             lock.unlock();
-            if(quit) break;
 
-            //int rand_depth = depth_dist(eng);
-            int rand_window = score_dist(eng);
-            auto fen = info.Position().GetFen();
-            if(board->GetFen() != fen)
+            searchInfo.NewSearch();
+            searchInfo.SetDepthLimit(depth_limit);
+            iterativeSearch(board, id);
+
+            lock.lock();
+            activeHelpers--;
+            lock.unlock();
+            helpersDone.notify_all();
+        }
+    }
+
+    // mark a thread as available for split points (mux must be held).
+    // A waiting master only accepts split points below the one it is waiting for
+    void Search::setIdle(int id, Board* board, SplitPoint* waitingFor)
+    {
+        receiver[id] = board;
+        waiting[id] = waitingFor;
+        idle[id] = true;
+        idleThreads++;
+    }
+
+    // search the split point assigned to the thread, then release it
+    void Search::helpSplitPoint(int id)
+    {
+        SplitPoint* sp;
+        Board* board;
+        {
+            // taken at once: the thread may wait for its own split points below this one
+            std::lock_guard<std::mutex> lock(mux);
+            sp = assigned[id];
+            board = receiver[id];
+            assigned[id] = nullptr;
+        }
+        SplitPoint* previous = activeSplit;
+
+        // helpers keep their own history and killers, cleared once per search
+        // (the main thread clears its own when the search starts)
+        if (id != 0 && infoAge != Age)
+        {
+            searchInfo.NewSearch();
+            infoAge = Age;
+        }
+
+        activeSplit = sp;
+        searchSplitPoint(*sp, *board);
+        activeSplit = previous;
+
+        std::lock_guard<std::mutex> lock(mux);
+        sp->slaves--;
+        helpersDone.notify_all();
+    }
+
+    // assign idle threads to the split point and search its remaining moves
+    // together with them. Returns false if no thread was available.
+    bool Search::split(SplitPoint& sp, Board& board)
+    {
+        int helpers = 0; // sp.slaves can already drop once the lock is released
+
+        {
+            std::lock_guard<std::mutex> lock(mux);
+            for (int i=0; i<cores; i++)
             {
-                searchInfo.NewSearch();
-                *board = info.Position();
+                if (!idle[i])
+                    continue;
+
+                SplitPoint* ancestor = sp.parent;
+                while (waiting[i] != nullptr && ancestor != nullptr && ancestor != waiting[i])
+                    ancestor = ancestor->parent;
+
+                if (waiting[i] != nullptr && ancestor == nullptr) // not below the split point it waits for
+                    continue;
+
+                *receiver[i] = board;
+                assigned[i] = &sp;
+                idle[i] = false;
+                idleThreads--;
+                sp.slaves++;
+                helpers++;
             }
+        }
 
-            searchRoot(info.Depth(), 
-                    info.Alpha() - rand_window, info.Beta() + rand_window, 
-                    std::ref(*move), std::ref(*board));
+        if (helpers == 0)
+            return false;
 
-            node_count += searchInfo.Nodes();
+        parallel.notify_all();
+        helpersDone.notify_all(); // waiting masters
+
+        activeSplit = &sp;
+        searchSplitPoint(sp, board);
+
+        // the moves are exhausted: until the helpers finish their current moves
+        // join the split points they create instead of sleeping (helpful master)
+        std::unique_lock<std::mutex> lock(mux);
+        while (sp.slaves > 0)
+        {
+            if (waitBoard.size() <= unsigned(waitLevel))
+                waitBoard.push_back(board);
+
+            setIdle(threadId, &waitBoard[waitLevel], &sp);
+            // the thread keeping the clock cannot leave it to its helpers while it waits
+            while (!helpersDone.wait_for(lock, std::chrono::milliseconds(5),
+                                         [&]{ return sp.slaves == 0 || assigned[threadId] != nullptr; }))
+            {
+                if (sendOutput)
+                    checkTime(board);
+            }
+
+            if (assigned[threadId] == nullptr)
+            {
+                idle[threadId] = false;
+                idleThreads--;
+                break;
+            }
+
+            lock.unlock();
+            waitLevel++;
+            helpSplitPoint(threadId);
+            waitLevel--;
+            lock.lock();
         }
+        activeSplit = sp.parent;
+
+        return true;
+    }
+
+    // pick moves from the shared move selector until none is left
+    // or a beta cutoff is found (by any thread)
+    void Search::searchSplitPoint(SplitPoint& sp, Board& board)
+    {
+        while (true)
+        {
+            sp.lock.lock();
+            Move move = sp.cutoff ? Constants::NullMove : sp.moves->Next(board, searchInfo);
+            int alpha = sp.alpha;
+            int moveNumber = sp.moveNumber++;
+            sp.lock.unlock();
+
+            if (move.IsNull() || StopSignal)
+                break;
+
+            bool pruned = false;
+            int newDepth;
+            // the eldest brother has already been searched, so every move gets a null window first
+            int score = searchMove<NodeType::NONPV>(move, moveNumber, sp.depth, alpha, sp.beta, sp.ply, board,
+                    sp.cut_node, sp.futility, sp.extension, sp.inCheck, false, pruned, newDepth);
+
+            if (cutoffOccurred() || StopSignal)
+                break;
+
+            sp.lock.lock();
+            if (pruned)
+                sp.pruned = true;
+            else if (score > sp.alpha)
+            {
+                sp.best = move;
+                if (score >= sp.beta)
+                    sp.cutoff = true;
+                else
+                {
+                    sp.alpha = score;
+                    sp.bound = ScoreType::Exact;
+                }
+            }
+            sp.lock.unlock();
+        }
+    }
+
+    // helpers skip some iterations so that threads spread over different depths
+    // instead of all searching the same tree in the same order
+    bool Search::skipDepth(int id, int depth, const Board& board)
+    {
+        // abdada threads share the work through deferred moves instead
+        if (id == 0 || parallelMode == ParallelMode::ABDADA)
+            return false;
+
+        int i = (id - 1) % 20;
+        return ((depth + board.CurrentPly() + SkipPhase[i]) / SkipSize[i]) % 2;
     }
 
     // iterative deepening
-    Move Search::iterativeSearch(Board& board)
+    Move Search::iterativeSearch(Board& board, int id)
     {
         Move move = Constants::NullMove;
         Move toMake = Constants::NullMove;
@@ -215,20 +497,20 @@ namespace Napoleon
         int score;
         int temp;
 
-        Age = (Age + 1) % 64;
         score = searchRoot(searchInfo.MaxDepth(), -Constants::Infinity, Constants::Infinity, move, board);
-        searchInfo.IncrementDepth();
         if (score != Constants::Unknown) {
           toMake = move;
           move_score = score;
+          results[id] = ThreadResult { toMake, move_score, searchInfo.MaxDepth(), searchInfo.MaxPly };
         }
+        searchInfo.IncrementDepth();
 
         while ((searchInfo.MaxDepth() < 100 && !searchInfo.TimeOver()) || pondering)
         {
             if (StopSignal)
                 break;
 
-            if(PonderHit && pondering)
+            if(PonderHit && pondering && id == 0)
             {
                 searchInfo.SetGameTime(predictTime(board.SideToMove()));
                 PonderHit = false;
@@ -236,12 +518,13 @@ namespace Napoleon
             }
             if (searchInfo.MaxDepth() >= 100) continue;
 
-            searchInfo.MaxPly = 0;
-            searchInfo.ResetNodes();
-            node_count = 0;
+            if (skipDepth(id, searchInfo.MaxDepth(), board))
+            {
+                searchInfo.IncrementDepth();
+                continue;
+            }
 
-            if (searchInfo.MaxDepth() > 4 && cores > 1)
-                signalThreads(searchInfo.MaxDepth(), -Constants::Infinity, Constants::Infinity, board, true);
+            searchInfo.MaxPly = 0;
 
             // aspiration search
             temp = searchRoot(searchInfo.MaxDepth(), score - AspirationValue, score + AspirationValue, move, board, toMake);
@@ -257,11 +540,15 @@ namespace Napoleon
             if (score != Constants::Unknown) {
                 toMake = move;
                 move_score = score;
+                results[id] = ThreadResult { toMake, move_score, searchInfo.MaxDepth(), searchInfo.MaxPly };
             }
 
             searchInfo.IncrementDepth();
         }
 
+        if (id != 0)
+            return toMake;
+
         StopThinking();
 
         if (record_positions)
@@ -278,7 +565,6 @@ namespace Napoleon
     int Search::searchRoot(int depth, int alpha, int beta, Move& moveToMake, Board& board, const Move candidate)
     {
         int score;
-        int startTime = searchInfo.ElapsedTime();
 
         MoveSelector moves(board, searchInfo);
         MoveGenerator::GetLegalMoves(moves.moves, moves.count, board);
@@ -299,6 +585,7 @@ namespace Napoleon
             if ((searchInfo.TimeOver() || StopSignal))
                 return Constants::Unknown;
 
+            Table.Prefetch(board.ZobristAfter(move));
             board.MakeMove(move);
             if (i == 0) // leftmost node
                 score = -Search::search<NodeType::PV>(depth - 1, -beta, -alpha, 1, board, false); // pv node
@@ -317,7 +604,7 @@ namespace Napoleon
                 if (score >= beta)
                 {
                     if (sendOutput)
-                        Uci::SendCommand<Command::Info>(GetInfo(board, moveToMake, beta, depth, startTime)); // sends info to the gui
+                        Uci::SendCommand<Command::Info>(GetInfo(board, moveToMake, beta, depth, searchInfo.MaxPly)); // sends info to the gui
 
                     return beta;
                 }
@@ -327,7 +614,7 @@ namespace Napoleon
         }
 
         if (sendOutput)
-            Uci::SendCommand<Command::Info>(GetInfo(board, moveToMake, alpha, depth, startTime)); // sends info to the gui
+            Uci::SendCommand<Command::Info>(GetInfo(board, moveToMake, alpha, depth, searchInfo.MaxPly)); // sends info to the gui
 
         return alpha;
     }
@@ -336,6 +623,7 @@ namespace Napoleon
         int Search::search(int depth, int alpha, int beta, int ply, Board& board, bool cut_node)
         {
             searchInfo.VisitNode();
+            countNode();
 
             ScoreType bound = ScoreType::Alpha;
             const bool pv = node_type == NodeType::PV;
@@ -349,20 +637,9 @@ namespace Napoleon
                 searchInfo.MaxPly = ply;
 
             if (searchInfo.Nodes() % 10000 == 0 && sendOutput) // every 10000 nodes visited we check for time expired and ponderhit
-            {
-                if (searchInfo.TimeOver())
-                    StopSignal = true;
-
-                if(PonderHit && pondering)
-                {
-                    searchInfo.SetGameTime(predictTime(board.SideToMove()));
-                    PonderHit = false;
-                    pondering = false;
-                }
-
-            }
+                checkTime(board);
 
-            if (StopSignal)
+            if (StopSignal || cutoffOccurred())
                 return alpha;
 
             // Mate distance pruning
@@ -372,7 +649,8 @@ namespace Napoleon
                 return alpha;
 
             // Transposition table lookup
-            auto hashHit = Table.Probe(board.zobrist, depth, Age, alpha, beta);
+            int hashEval;
+            auto hashHit = Table.Probe(board.zobrist, depth, Age, alpha, beta, hashEval);
 
             if ((score = hashHit.first) != TranspositionTable::Unknown)
                 return score;
@@ -392,8 +670,21 @@ namespace Napoleon
             if (board.IsDraw())
                 return 0;
 
+            // static evaluation, reused from the transposition table when possible.
+            // The window is widened by the pruning margins below, so a lazy evaluation
+            // only changes a pruning decision when the skipped terms exceed LazyMargin
+            int eval = hashEval;
+            if (eval == HashEntry::NoEval && !attackers)
+            {
+                int lazyAlpha = alpha - (depth <= 3 ? std::max({razorMargin(depth), param[FUTILITY1], param[FUTILITY2]}) : 0);
+                int lazyBeta = beta + (depth <= param[REVERSENULL_DEPTH] ? param[REVERSENULL1] + param[REVERSENULL2]*depth : 0);
+
+                eval = Evaluation::Evaluate(board, evalContext, lazyAlpha, lazyBeta);
+                if (!evalContext.lazy) // partial scores are not stored in the table
+                    hashEval = eval;
+            }
+
             // static null move pruning
-            int eval = Evaluation::Evaluate(board);
             if (depth <= param[REVERSENULL_DEPTH]
                     && !pv
                     && !attackers
@@ -449,7 +740,7 @@ namespace Napoleon
                     board.ToggleNullMove();
 
                 //Transposition table lookup
-                auto hashHit = Table.Probe(board.zobrist, depth, Age, alpha, beta);
+                auto hashHit = Table.Probe(board.zobrist, depth, Age, alpha, beta, hashEval);
 
                 best = hashHit.second;
             }
@@ -541,138 +832,116 @@ namespace Napoleon
             */
 
             // principal variation search
-            bool capture;
             bool pruned = false;
 
             int moveNumber = 0;
             int newDepth = depth;
-            BitBoard pinned = board.PinnedPieces();
 
-            MoveSelector moves(board, searchInfo);
-
-            MoveGenerator::GetPseudoLegalMoves<false>(moves.moves, moves.count, attackers, board); // get captures and non-captures
-            moves.Sort<false>(ply);
-            moves.hashMove = best;
+            MoveSelector moves(board, searchInfo, best, ply, attackers); // moves are generated lazily
 
             for (auto move = moves.First(); !move.IsNull(); move = moves.Next())
             {
-                if (board.IsMoveLegal(move, pinned))
-                {
-                    legal++;
-
-                    int E = 0;
-
-                    // singular extension (TO TEST)
-                    //                if (move == excluded)
-                    //                    continue;
-
-                    //                if (pv
-                    //                        && depth >= 8
-                    //                        && excluded.IsNull()
-                    //                        && !extension
-                    //                        && !moves.hashMove.IsNull()
-                    //                        && move == moves.hashMove)
-                    //                {
-
-                    //                    int value = search<false>(depth/2, alpha-1, alpha, ply, board, moves.hashMove);
-
-                    //                    if (value < alpha)
-                    //                    {
-                    //                        extension = true;
-                    //                        E = 1;
-                    //                    }
-                    //                }
-
-                    newDepth = depth + E;
-
-                    capture = board.IsCapture(move);
-                    board.MakeMove(move);
-
-                    // futility pruning application
-                    if (futility
-                            && moveNumber > 0
-                            && !capture
-                            && !move.IsPromotion()
-                            && !board.KingAttackers(board.KingSquare(board.SideToMove()), board.SideToMove())
-                       )
-                    {
-                        pruned = true;
-                        board.UndoMove(move);
-                        continue;
-                    }
+                // abdada: on the first visit, postpone moves that other threads are already searching
+                bool defer = parallelMode == ParallelMode::ABDADA
+                    && cores > 1
+                    && moveNumber > 0
+                    && depth >= MinDeferDepth
+                    && !moves.Revisiting();
 
-                    if (moveNumber == 0)
-                    {
-                        score = -search<node_type>(newDepth - 1, -beta, -alpha, ply + 1, board, !cut_node);
-                    }
-                    else
-                    {
-                        register int R = 0;
-                        register int N = newDepth >= param[LMR_DEPTH1] ? param[LMR_DEPTH2] : param[LMR_DEPTH3]; // TO TEST
-
-                        // late move reduction
-                        if (moveNumber >= N
-                                && newDepth >= 3
-                                && !extension
-                                && !capture
-                                && !move.IsPromotion()
-                                && !attackers
-                                && move != searchInfo.FirstKiller(ply)
-                                && move != searchInfo.SecondKiller(ply)
-                                && !board.KingAttackers(board.KingSquare(board.SideToMove()), board.SideToMove())
-                           )
-                        {
-                            R = param[LMR_R1];
+                score = searchMove<node_type>(move, moveNumber, depth, alpha, beta, ply, board,
+                        cut_node, futility, extension, attackers, defer, pruned, newDepth);
 
-                            if (moveNumber > param[LMR_MARGIN])
-                            {
-                                R = param[LMR_R2];
-                                //if (searchInfo.HistoryScore(move, Utils::Piece::GetOpposite(board.SideToMove())) < 500)
-                                //{
-                                //board.UndoMove(move);
-                                //continue;
-                                //}
-                            }
-                        }
+                if (score == Deferred)
+                {
+                    moves.Defer(move);
+                    continue;
+                }
 
-                        newDepth = std::max(1, depth - R);
+                legal++;
 
-                        score = -search<NodeType::NONPV>(newDepth - 1, -alpha - 1, -alpha, ply + 1, board, !cut_node);
+                if (score == Constants::Unknown) // futility pruned
+                    continue;
 
-                        //                    if (score > alpha)
-                        //                        score = -search<false>(newdepth-1, -alpha-1, -alpha, ply+1, board);
+                // the search has been aborted by a cutoff found by another thread
+                if (cutoffOccurred())
+                    return alpha;
 
-                        if (score > alpha)
-                        {
-                            newDepth = depth;
-                            score = -search<NodeType::PV>(newDepth - 1, -beta, -alpha, ply + 1, board, !cut_node);
-                        }
+                if (score >= beta)
+                {
+                    //killer moves and history heuristic
+                    if (!board.IsCapture(move))
+                    {
+                        searchInfo.SetKillers(move, ply);
+                        searchInfo.SetHistory(move, board.SideToMove(), newDepth);
                     }
 
-                    board.UndoMove(move);
+                    // for safety, we don't save forward pruned nodes inside transposition table
+                    if (!pruned) 
+                        Table.Save(board.zobrist, newDepth, Age, beta, hashEval, best, ScoreType::Beta);
 
-                    if (score >= beta)
+                    return beta;   //  fail hard beta-cutoff
+                }
+                if (score > alpha)
+                {
+                    bound = ScoreType::Exact;
+                    alpha = score; // alpha acts like max in MiniMax
+                    best = move;
+                }
+                moveNumber++;
+
+                // young brothers wait: once the eldest brother has been searched
+                // idle threads may join the search of the remaining moves
+                if (parallelMode == ParallelMode::YBWC
+                        && idleThreads > 0
+                        && depth >= MinSplitDepth
+                        && (pv || !cut_node) // PV and ALL nodes
+                        && !StopSignal)
+                {
+                    SplitPoint sp;
+                    sp.parent = activeSplit;
+                    sp.moves = &moves;
+                    sp.depth = depth;
+                    sp.ply = ply;
+                    sp.beta = beta;
+                    sp.cut_node = cut_node;
+                    sp.futility = futility;
+                    sp.extension = extension;
+                    sp.inCheck = attackers;
+                    sp.alpha = alpha;
+                    sp.moveNumber = moveNumber;
+                    sp.pruned = pruned;
+                    sp.best = best;
+                    sp.bound = bound;
+                    sp.cutoff = false;
+                    sp.slaves = 0;
+
+                    if (split(sp, board))
                     {
-                        //killer moves and history heuristic
-                        if (!board.IsCapture(move))
+                        if (StopSignal || cutoffOccurred())
+                            return alpha;
+
+                        pruned = sp.pruned;
+                        newDepth = depth;
+
+                        if (sp.cutoff)
                         {
-                            searchInfo.SetKillers(move, ply);
-                            searchInfo.SetHistory(move, board.SideToMove(), newDepth);
-                        }
+                            if (!board.IsCapture(sp.best))
+                            {
+                                searchInfo.SetKillers(sp.best, ply);
+                                searchInfo.SetHistory(sp.best, board.SideToMove(), depth);
+                            }
 
-                        // for safety, we don't save forward pruned nodes inside transposition table
-                        if (!pruned) 
-                            Table.Save(board.zobrist, newDepth, Age, beta, best, ScoreType::Beta);
+                            if (!pruned)
+                                Table.Save(board.zobrist, depth, Age, beta, hashEval, sp.best, ScoreType::Beta);
 
-                        return beta;   //  fail hard beta-cutoff
-                    }
-                    if (score > alpha)
-                    {
-                        bound = ScoreType::Exact;
-                        alpha = score; // alpha acts like max in MiniMax
-                        best = move;
+                            return beta;
+                        }
+
+                        alpha = sp.alpha;
+                        best = sp.best;
+                        bound = sp.bound;
+                        break;
                     }
-                    moveNumber++;
                 }
             }
 
@@ -692,15 +961,136 @@ namespace Napoleon
 
             // for safety, we don't save forward pruned nodes inside transposition table
             if (!pruned)
-                Table.Save(board.zobrist, newDepth, Age, alpha, best, bound);
+                Table.Save(board.zobrist, newDepth, Age, alpha, hashEval, best, bound);
 
             return alpha;
         }
 
+    // search a single (legal) move of the principal variation search loop.
+    // Returns Constants::Unknown if the move has been futility pruned
+    // and Deferred if defer is set and another thread is searching the move.
+    template<NodeType node_type>
+        int Search::searchMove(Move move, int moveNumber, int depth, int alpha, int beta, int ply, Board& board,
+                bool cut_node, bool futility, bool extension, bool inCheck, bool defer, bool& pruned, int& newDepth)
+        {
+            int score;
+            int E = 0;
+
+            // singular extension (TO TEST)
+            //                if (move == excluded)
+            //                    continue;
+
+            //                if (pv
+            //                        && depth >= 8
+            //                        && excluded.IsNull()
+            //                        && !extension
+            //                        && !moves.hashMove.IsNull()
+            //                        && move == moves.hashMove)
+            //                {
+
+            //                    int value = search<false>(depth/2, alpha-1, alpha, ply, board, moves.hashMove);
+
+            //                    if (value < alpha)
+            //                    {
+            //                        extension = true;
+            //                        E = 1;
+            //                    }
+            //                }
+
+            newDepth = depth + E;
+
+            bool capture = board.IsCapture(move);
+            Table.Prefetch(board.ZobristAfter(move)); // the bucket loads while the move is made
+            board.MakeMove(move);
+            Evaluation::pawnTable.Prefetch(board.pawnKey);
+
+            // futility pruning application
+            if (futility
+                    && moveNumber > 0
+                    && !capture
+                    && !move.IsPromotion()
+                    && !board.KingAttackers(board.KingSquare(board.SideToMove()), board.SideToMove())
+               )
+            {
+                pruned = true;
+                board.UndoMove(move);
+                return Constants::Unknown;
+            }
+
+            if (defer && Table.IsSearching(board.zobrist))
+            {
+                board.UndoMove(move);
+                return Deferred;
+            }
+
+            bool marked = parallelMode == ParallelMode::ABDADA
+                && cores > 1
+                && depth >= MinDeferDepth;
+
+            if (marked)
+                Table.StartSearch(board.zobrist, Age);
+
+            if (moveNumber == 0)
+            {
+                score = -search<node_type>(newDepth - 1, -beta, -alpha, ply + 1, board, !cut_node);
+            }
+            else
+            {
+                int R = 0;
+                int N = newDepth >= param[LMR_DEPTH1] ? param[LMR_DEPTH2] : param[LMR_DEPTH3]; // TO TEST
+
+                // late move reduction
+                if (moveNumber >= N
+                        && newDepth >= 3
+                        && !extension
+                        && !capture
+                        && !move.IsPromotion()
+                        && !inCheck
+                        && move != searchInfo.FirstKiller(ply)
+                        && move != searchInfo.SecondKiller(ply)
+                        && !board.KingAttackers(board.KingSquare(board.SideToMove()), board.SideToMove())
+                   )
+                {
+                    R = param[LMR_R1];
+
+                    if (moveNumber > param[LMR_MARGIN])
+                    {
+                        R = param[LMR_R2];
+                        //if (searchInfo.HistoryScore(move, Utils::Piece::GetOpposite(board.SideToMove())) < 500)
+                        //{
+                        //board.UndoMove(move);
+                        //continue;
+                        //}
+                    }
+                }
+
+                newDepth = std::max(1, depth - R);
+
+                score = -search<NodeType::NONPV>(newDepth - 1, -alpha - 1, -alpha, ply + 1, board, !cut_node);
+
+                //                    if (score > alpha)
+                //                        score = -search<false>(newdepth-1, -alpha-1, -alpha, ply+1, board);
+
+                if (score > alpha)
+                {
+                    newDepth = depth;
+                    score = -search<NodeType::PV>(newDepth - 1, -beta, -alpha, ply + 1, board, !cut_node);
+                }
+            }
+
+            if (marked)
+                Table.FinishSearch(board.zobrist);
+
+            board.UndoMove(move);
+
+            return score;
+        }
+
     // quiescence is called at horizon nodes (depth = 0)
     int Search::quiescence(int alpha, int beta, Board& board)
     {
         searchInfo.VisitNode();
+        countNode();
 
         const BitBoard attackers = board.KingAttackers(board.KingSquare(board.SideToMove()), board.SideToMove());
         const bool inCheck = attackers;
@@ -710,15 +1100,17 @@ namespace Napoleon
         int Delta;
         if (!inCheck)
         {
-            stand_pat = Evaluation::Evaluate(board);
+            stand_pat = Table.ProbeEval(board.zobrist);
+            if (stand_pat == HashEntry::NoEval)
+            {
+                stand_pat = Evaluation::Evaluate(board, evalContext, alpha, beta);
+                if (!evalContext.lazy) // partial scores are not stored in the table
+                    Table.Save(board.zobrist, 0, Age, 0, stand_pat, Constants::NullMove, ScoreType::EvalOnly);
+            }
+
             if (stand_pat >= beta)
                 return beta;
 
-            /*
-               Delta = Evaluation::hangingValue[Utils::Piece::GetOpposite(board.SideToMove())];
-               Delta = 200 + std::max(Constants::Piece::PieceValue[PieceType::Pawn], Delta);
-               Delta = std::min(Constants::Piece::PieceValue[PieceType::Queen], Delta);
-               */
             Delta = Constants::Piece::PieceValue[PieceType::Queen];
 
             if (board.IsPromotingPawn())
@@ -741,9 +1133,9 @@ namespace Napoleon
         MoveSelector moves(board, searchInfo);
 
         if (!inCheck)
-            MoveGenerator::GetPseudoLegalMoves<true>(moves.moves, moves.count, attackers, board); // get all capture moves
+            MoveGenerator::GetLegal<MoveGenerator::GenType::Captures>(moves.moves, moves.count, board, attackers, pinned); // get all capture moves
         else
-            MoveGenerator::GetPseudoLegalMoves<false>(moves.moves, moves.count, attackers, board); // get all evading moves
+            MoveGenerator::GetLegal<MoveGenerator::GenType::All>(moves.moves, moves.count, board, attackers, pinned); // get all evading moves
 
         moves.Sort<true>();
 
@@ -763,17 +1155,15 @@ namespace Napoleon
                     continue;
             }
 
-            if (board.IsMoveLegal(move, pinned))
-            {
-                board.MakeMove(move);
-                score = -quiescence(-beta, -alpha, board);
-                board.UndoMove(move);
+            Table.Prefetch(board.ZobristAfter(move));
+            board.MakeMove(move);
+            score = -quiescence(-beta, -alpha, board);
+            board.UndoMove(move);
 
-                if (score >= beta)
-                    return beta;
-                if (score > alpha)
-                    alpha = score;
-            }
+            if (score >= beta)
+                return beta;
+            if (score > alpha)
+                alpha = score;
         }
 
         return alpha;
@@ -799,14 +1189,24 @@ namespace Napoleon
     }
 
     // return search info
-    std::string Search::GetInfo(Board& board, Move toMake, int score, int depth, int lastTime)
+    // nodes searched by all the threads since the search started
+    unsigned long Search::NodeCount()
+    {
+        unsigned long nodes = 0;
+        for (int i=0; i<cores; i++)
+            nodes += nodeCount[i].nodes.load(std::memory_order_relaxed);
+
+        return nodes;
+    }
+
+    std::string Search::GetInfo(Board& board, Move toMake, int score, int depth, int seldepth)
     {
         std::ostringstream info;
-        double delta = searchInfo.ElapsedTime() - lastTime;
-        unsigned long nodes = searchInfo.Nodes() + node_count;
-        unsigned long nps = (delta > 0 ? nodes / delta : nodes / 1) * 1000;
+        double elapsed = searchInfo.ElapsedTime();
+        unsigned long nodes = NodeCount();
+        unsigned long nps = elapsed > 0 ? nodes / elapsed * 1000 : nodes * 1000;
 
-        info << "depth " << depth << " seldepth " << searchInfo.MaxPly;
+        info << "depth " << depth << " seldepth " << seldepth;
 
         if (std::abs(score) >= Constants::Mate - Constants::MaxPly)
         {
@@ -819,8 +1219,8 @@ namespace Napoleon
         else
             info << " score cp " << score;
 
-        info << " time " << searchInfo.ElapsedTime() << " nodes "
-            << searchInfo.Nodes() << " nps " << nps << " pv " << GetPv(board, toMake, depth);
+        info << " time " << elapsed << " nodes "
+            << nodes << " nps " << nps << " pv " << GetPv(board, toMake, depth);
 
         return info.str();
     }
@@ -4,8 +4,9 @@
 #include "move.h"
 #include "constants.h"
 #include "searchinfo.h"
-#include "parallelinfo.h"
+#include "splitpoint.h"
 #include <cstring>
+#include <mutex>
 #include <condition_variable>
 #include <vector>
 #include <thread>
@@ -24,8 +25,25 @@ namespace Napoleon
         PV, NONPV, CUT, ALL
     };
 
+    enum class ParallelMode
+    {
+        LazySMP, YBWC, ABDADA
+    };
+
     class Board;
     class TranspositionTable;
+    class EvalContext;
+
+    // result of the last iteration completed by a search thread
+    class ThreadResult
+    {
+        public:
+            Move move;
+            int score;
+            int depth;
+            int seldepth;
+    };
+
     namespace Search
     {
         extern const int AspirationValue;
@@ -35,12 +53,19 @@ namespace Napoleon
         extern int MoveTime;
         extern int GameTime[2]; // by color
         extern thread_local SearchInfo searchInfo;
+        extern thread_local EvalContext evalContext;
         extern thread_local bool sendOutput;
         extern TranspositionTable Table;
         extern std::condition_variable parallel;
-        extern ParallelInfo parallelInfo;
         extern std::vector<std::thread> threads;
+        extern std::vector<ThreadResult> results; // thread id
+        extern ParallelMode parallelMode;
+        extern const int MinSplitDepth;
+        extern const int MinDeferDepth;
+        extern const int Deferred;
+        extern thread_local SplitPoint* activeSplit;
         extern int depth_limit;
+        extern int Age; // transposition table generation of the current search
         extern int cores;
         extern std::atomic<bool> quit;
         extern const int default_cores;
@@ -63,21 +88,32 @@ namespace Napoleon
 
         void InitializeThreads(int = default_cores);
         void KillThreads();
-        void signalThreads(int, int, int, const Board&, bool);
-        void parallelSearch();
+        void startHelpers(const Board&);
+        void waitHelpers();
+        void parallelSearch(int);
+        bool skipDepth(int, int, const Board&);
+        void setIdle(int, Board*, SplitPoint*);
+        void helpSplitPoint(int);
+        bool split(SplitPoint&, Board&);
+        void searchSplitPoint(SplitPoint&, Board&);
+        bool cutoffOccurred();
         int predictTime(Color);
+        void checkTime(Board&);
 
         std::string GetInfo(Board&, Move, int, int, int);
+        unsigned long NodeCount();
         std::string GetPv(Board&, Move, int);
         Move getPonderMove(Board&, const Move);
 
         Move StartThinking(SearchType, Board&, bool=true, bool=false);
         void StopThinking();
-        Move iterativeSearch(Board&);
+        Move iterativeSearch(Board&, int = 0);
         int searchRoot(int, int, int, Move&, Board&, const Move=Constants::NullMove);
 
         template<NodeType>
             int search(int, int, int, int, Board&, bool);
+        template<NodeType>
+            int searchMove(Move, int, int, int, int, int, Board&, bool, bool, bool, bool, bool, bool&, int&);
         int quiescence(int, int, Board&);
 
         int razorMargin(int);
@@ -87,6 +123,16 @@ namespace Napoleon
     {
         return (param[RAZOR1]*(depth-param[RAZOR2]) + param[RAZOR3]);
     }
+
+    // true if a beta cutoff happened at the current split point or at one of its ancestors
+    inline bool Search::cutoffOccurred()
+    {
+        for (auto sp = activeSplit; sp != nullptr; sp = sp->parent)
+            if (sp->cutoff)
+                return true;
+
+        return false;
+    }
 }
 
 #endif // SEARCH_H
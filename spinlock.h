@@ -1,20 +1,38 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
 #include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 class SpinLock
 {
     public:
         void lock()
         {
-            while(lck.test_and_set(std::memory_order_acquire))
-            {}
+            // test and test-and-set: spin on a plain load so that waiting
+            // threads don't keep stealing the cache line from the owner
+            while(lck.exchange(true, std::memory_order_acquire))
+            {
+                while (lck.load(std::memory_order_relaxed))
+                    pause();
+            }
         }
 
         void unlock()
         {
-            lck.clear(std::memory_order_release);
+            lck.store(false, std::memory_order_release);
         }
 
     private:
-        std::atomic_flag lck = ATOMIC_FLAG_INIT;
+        std::atomic<bool> lck { false };
+
+        static void pause()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
 };
 
+#endif // SPINLOCK_H
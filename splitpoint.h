@@ -0,0 +1,43 @@
+#ifndef SPLITPOINT_H
+#define SPLITPOINT_H
+#include "defines.h"
+#include "move.h"
+#include "hashentry.h"
+#include "spinlock.h"
+#include <atomic>
+
+namespace Napoleon
+{
+    class Board;
+    class MoveSelector;
+
+    // Young Brothers Wait split point: holds the state of a node whose remaining
+    // moves are shared between the master thread and its helpers.
+    // Every mutable field is guarded by lock.
+    class SplitPoint
+    {
+        public:
+            SplitPoint* parent;
+            MoveSelector* moves;
+
+            int depth;
+            int ply;
+            int beta;
+            bool cut_node;
+            bool futility;
+            bool extension;
+            bool inCheck;
+
+            int alpha;
+            int moveNumber;
+            bool pruned;
+            Move best;
+            ScoreType bound;
+
+            std::atomic<bool> cutoff;
+            std::atomic<int> slaves;
+            SpinLock lock;
+    };
+}
+
+#endif // SPLITPOINT_H
@@ -5,119 +5,287 @@
 #include <cstring>
 #include <iostream>
 #include <cassert>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <new>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 namespace Napoleon
 {    
-    const int TranspositionTable::BucketSize = 1;
+    const int TranspositionTable::BucketSize = HashBucket::Size;
+    const int TranspositionTable::AgeWeight = 8;
     const int TranspositionTable::Unknown = -999999;
     unsigned long stores = 0;
 
+    // header of a table saved to disk, followed by the raw buckets
+    class TableHeader
+    {
+        public:
+            char magic[8];
+            unsigned int bucketSize; // bytes
+            unsigned int entries; // per bucket
+            unsigned int layout; // HashEntry::Layout
+            unsigned int age;
+            unsigned long long buckets;
+    };
+
+    const char Magic[8] = "NAPTT";
+
     TranspositionTable::TranspositionTable(int mb)
     {
         SetSize(mb);
     }
 
-    void TranspositionTable::SetSize(int mb)
+    void TranspositionTable::SetSize(int mb, int threads)
     {
-        // get a power of two size in megabytes
-        mb = std::pow(2, int(Utils::Math::Log2(mb)));
+        // any size is allowed: buckets are indexed with a multiply-shift instead of a mask
+        allocate(((unsigned long long)mb << 20) / sizeof(HashBucket)); // number of bytes / size of HashBucket = number of buckets
+        Clear(threads); // first touch
+    }
 
-        // mb * 2^x = mb << x   <==>   mb = 2^k
-        entries = ( (mb*std::pow(2, 20)) / sizeof(HashEntry)); // number of bytes * size of HashEntry = number of entries
-        lock_entries = (entries / BucketSize);
+    void TranspositionTable::allocate(unsigned long long count)
+    {
+        release(table, buckets, pages);
 
-        free(table);
-        free(locks);
-        table = (HashEntry*) std::calloc(entries * sizeof(HashEntry), 1);
-        locks = new SpinLock[lock_entries];
+        // page aligned, so buckets lie on cache line boundaries.
+        // A table that does not fit in the memory left is halved until it does
+        for (buckets = count; buckets > 0; buckets /= 2)
+        {
+            table = (HashBucket*) Utils::Memory::AllocateLarge(buckets * sizeof(HashBucket), pages);
+            if (table != nullptr)
+                return;
+        }
 
-        mask = entries - BucketSize;
+        throw std::bad_alloc();
     }
 
-    void TranspositionTable::Save(ZobristKey key, Byte depth, Byte age, int score, Move move, ScoreType bound)
+    // change the size of the table keeping its entries: each thread moves a slice of
+    // the old buckets into the new table, choosing slots with the replacement policy.
+    // Concurrent inserts into the same bucket can lose an entry, never corrupt one
+    void TranspositionTable::Resize(int mb, Byte age, int threads)
     {
-        SpinLock* mux = locks + (key & mask)/BucketSize;;
+        HashBucket* old = table;
+        unsigned long long oldBuckets = buckets;
+        auto oldPages = pages;
 
-        if (Concurrent)
-            mux->lock();
+        table = nullptr; // keep the old table alive
+        SetSize(mb, threads);
 
-        //stores++;
+        forEachSlice(threads, oldBuckets, [this, old, age](unsigned long long first, unsigned long long count)
+        {
+            for (auto bucket = old + first; bucket < old + first + count; bucket++)
+                for (const auto& entry : bucket->entries)
+                    if (entry.Hash || entry.Data)
+                        insert(entry, age);
+        });
+
+        release(old, oldBuckets, oldPages);
+    }
+
+    // replace the table with the named shared memory block, created with the given size
+    // if no other process uses it yet (otherwise the table takes the size of the block).
+    // Entries written by other processes are validated by the xor-ed key like those of other threads
+    bool TranspositionTable::Share(const std::string& name, int mb)
+    {
+        std::size_t size = (std::size_t)mb << 20;
+        auto memory = (HashBucket*) Utils::Memory::AttachShared(name, size);
+
+        if (memory == nullptr)
+            return false;
 
-        int min = Constants::MaxPly;
+        release(table, buckets, pages);
+
+        table = memory;
+        buckets = size / sizeof(HashBucket);
+        pages = Utils::Memory::PageType::Shared;
+        return true;
+    }
+
+    void TranspositionTable::release(HashBucket* memory, unsigned long long count, Utils::Memory::PageType type)
+    {
+        if (type == Utils::Memory::PageType::Shared)
+            Utils::Memory::DetachShared(memory, count * sizeof(HashBucket));
+        else
+            Utils::Memory::FreeLarge(memory, count * sizeof(HashBucket));
+    }
+
+    void TranspositionTable::insert(const HashEntry& entry, Byte age)
+    {
+        auto key = entry.Key();
         auto hash = at(key);
-        HashEntry* hashToOverride = nullptr;
+        HashEntry* hashToOverride = hash;
+        int min = value(*hash, age);
 
         for (auto i=0; i<BucketSize; i++, hash++)
         {
-            /*
-            if (age != (hash->Bound >> 2))
-            {
-                hashToOverride = hash;
-                break;
-            }
-            */
-            if (hash->Depth < min)
+            int v = value(*hash, age);
+            if (v < min)
             {
-                min = hash->Depth;
+                min = v;
                 hashToOverride = hash;
             }
         }
 
-        assert(hashToOverride != nullptr);
+        // when shrinking, shallow entries make room for deeper ones
+        if (value(entry, age) >= min)
+        {
+            auto data = HashEntry::Pack(entry.Depth(), entry.Bound(), 0, entry.Score(), entry.Eval(), entry.BestMove());
+            hashToOverride->Data = data;
+            hashToOverride->Hash = key ^ data;
+        }
+    }
+
+    // split count buckets among threads, the calling thread works on the first slice
+    template<typename Function>
+    void TranspositionTable::forEachSlice(int threads, unsigned long long count, Function function)
+    {
+        std::vector<std::thread> workers;
+        unsigned long long slice = count / threads;
+
+        for (int i=1; i<threads; i++)
+            workers.push_back(std::thread(function, i*slice, i == threads - 1 ? count - i*slice : slice));
+
+        function(0, threads > 1 ? slice : count);
 
-        hashToOverride->Hash = key;
-        hashToOverride->Score = score;
-        hashToOverride->Depth = depth;
-        hashToOverride->Bound = (bound | (age << 2));
-        hashToOverride->BestMove = move;
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    // the table is lockless: entries are written without synchronization and
+    // torn writes are detected on probe through the xor-ed key (see HashEntry)
+    void TranspositionTable::Save(ZobristKey key, Byte depth, Byte age, int score, int eval, Move move, ScoreType bound)
+    {
+        //stores++;
+
+        HashEntry* hashToOverride = slot(key, age);
+        HashEntry entry = *hashToOverride;
+        Byte searching = 0;
+
+        if (entry.Key() == key)
+        {
+            // a static evaluation alone never replaces a search result
+            if (bound == ScoreType::EvalOnly && (entry.Bound() & 0x3) != ScoreType::EvalOnly)
+                return;
+
+            searching = entry.Searching();
 
-        mux->unlock();
+            if (move.IsNull()) // keep the move of a previous search of this position
+                move = entry.BestMove();
+
+            if (eval == HashEntry::NoEval)
+                eval = entry.Eval();
+        }
+
+        auto data = HashEntry::Pack(depth, (bound | (age << 2)), searching, score, eval, move);
+
+        hashToOverride->Data = data;
+        hashToOverride->Hash = key ^ data;
     }
 
-    std::pair<int, Move> TranspositionTable::Probe(ZobristKey key, Byte depth, Byte age, int alpha, int beta)
+    // entry holding the position if any, otherwise the shallowest/oldest entry of its bucket
+    HashEntry* TranspositionTable::slot(ZobristKey key, Byte age) const
     {
-        SpinLock* mux = locks + (key & mask)/BucketSize;
+        auto hash = at(key);
+        HashEntry* hashToOverride = hash;
+        int min = value(*hash, age);
 
-        if (Concurrent)
-            mux->lock();
+        for (auto i=0; i<BucketSize; i++, hash++)
+        {
+            // always overwrite the same position
+            if (hash->Key() == key)
+                return hash;
 
+            // otherwise replace the shallowest/oldest entry
+            int v = value(*hash, age);
+            if (v < min)
+            {
+                min = v;
+                hashToOverride = hash;
+            }
+        }
+
+        return hashToOverride;
+    }
+
+    // eval is set to the cached static evaluation of the position (HashEntry::NoEval if unknown)
+    std::pair<int, Move> TranspositionTable::Probe(ZobristKey key, Byte depth, Byte age, int alpha, int beta, int& eval)
+    {
         auto hash = at(key);
         auto move = Constants::NullMove;
+        eval = HashEntry::NoEval;
 
         for (auto i=0; i<BucketSize; i++, hash++)
         {
-            if (hash->Hash == key)
+            HashEntry entry = *hash; // work on a local copy so that the key check stays valid
+
+            if (entry.Key() == key)
             {
-                hash->Bound = ((hash->Bound & 0x3) | (age << 2));
-                if (hash->Depth >= depth)
+                Byte bound = entry.Bound() & 0x3;
+                eval = entry.Eval();
+
+                if ((entry.Bound() >> 2) != age) // refresh age
+                {
+                    auto data = HashEntry::Pack(entry.Depth(), (bound | (age << 2)), entry.Searching(), entry.Score(), entry.Eval(), entry.BestMove());
+                    hash->Data = data;
+                    hash->Hash = key ^ data;
+                }
+
+                if (entry.Depth() >= depth)
                 {
-                    if ((hash->Bound & 0x3) == ScoreType::Exact)
-                    { mux->unlock(); return std::make_pair(hash->Score, move); }
+                    if (bound == ScoreType::Exact)
+                        return std::make_pair(entry.Score(), move);
 
-                    if ((hash->Bound & 0x3) == ScoreType::Alpha && hash->Score <= alpha)
-                    { mux->unlock(); return std::make_pair(alpha, move); }
+                    if (bound == ScoreType::Alpha && entry.Score() <= alpha)
+                        return std::make_pair(alpha, move);
 
-                    if ((hash->Bound & 0x3) == ScoreType::Beta && hash->Score >= beta)
-                    { mux->unlock(); return std::make_pair(beta, move); }
+                    if (bound == ScoreType::Beta && entry.Score() >= beta)
+                        return std::make_pair(beta, move);
                 }
-                move = hash->BestMove; // get best move on this position
+                move = entry.BestMove(); // get best move on this position
             }
         }
 
-        mux->unlock();
         return std::make_pair(Unknown, move);
     }
 
-    void TranspositionTable::Clear()
+    // cached static evaluation of the position, HashEntry::NoEval if unknown
+    int TranspositionTable::ProbeEval(ZobristKey key) const
+    {
+        auto hash = at(key);
+
+        for (auto i=0; i<BucketSize; i++, hash++)
+        {
+            HashEntry entry = *hash;
+
+            if (entry.Key() == key)
+                return entry.Eval();
+        }
+
+        return HashEntry::NoEval;
+    }
+
+    // the slices are zeroed in parallel, which makes clearing a big table faster.
+    // The workers are temporary threads, not the search threads, so the first touch
+    // does not place the pages on the numa nodes of the threads that will probe them
+    void TranspositionTable::Clear(int threads)
     {
-        std::memset(table, 0, entries*sizeof(HashEntry)); // clear first half
+        forEachSlice(threads, buckets, [this](unsigned long long first, unsigned long long count)
+        {
+            std::memset(table + first, 0, count*sizeof(HashBucket));
+        });
         // DO NOT CLEAR
 
         /*
            auto hash = table;
            unsigned long gen[64] = {0};
            unsigned long empty = 0;
-           for (unsigned long i=0; i<entries; i++, hash++)
+           for (unsigned long i=0; i<buckets*BucketSize; i++, hash++)
            {
            if (!hash->Hash)
            {
@@ -141,6 +309,98 @@ namespace Napoleon
 
     }
 
+    // write the table to disk. Entries being written by a running search
+    // may be saved torn, they will fail the key check once loaded
+    bool TranspositionTable::Dump(const std::string& file, Byte age) const
+    {
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+
+        TableHeader header;
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.bucketSize = sizeof(HashBucket);
+        header.entries = BucketSize;
+        header.layout = HashEntry::Layout;
+        header.age = age;
+        header.buckets = buckets;
+
+        out.write((const char*)&header, sizeof(TableHeader));
+        out.write((const char*)table, buckets * sizeof(HashBucket));
+
+        return bool(out);
+    }
+
+    // replace the table with one saved by Dump: the table takes the size
+    // recorded in the file and age is set to the age of the saved search
+    bool TranspositionTable::Load(const std::string& file, Byte& age, int threads)
+    {
+        TableHeader header;
+#if defined(_WIN32)
+        std::ifstream in(file, std::ios::binary);
+        if (!in.read((char*)&header, sizeof(TableHeader)))
+            return false;
+
+        in.seekg(0, std::ios::end);
+        unsigned long long size = in.tellg();
+        in.seekg(sizeof(TableHeader));
+#else
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (unsigned long long)info.st_size < sizeof(TableHeader))
+        {
+            close(fd);
+            return false;
+        }
+
+        unsigned long long size = info.st_size;
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (mapping == MAP_FAILED)
+            return false;
+
+        std::memcpy(&header, mapping, sizeof(TableHeader));
+        const char* data = (const char*)mapping + sizeof(TableHeader);
+#endif
+
+        bool valid = std::memcmp(header.magic, Magic, sizeof(Magic)) == 0
+            && header.bucketSize == sizeof(HashBucket)
+            && header.entries == (unsigned int)BucketSize
+            && header.layout == (unsigned int)HashEntry::Layout
+            && header.buckets > 0
+            && size == sizeof(TableHeader) + header.buckets * sizeof(HashBucket);
+
+        if (valid)
+        {
+            allocate(header.buckets);
+            age = header.age % HashEntry::Generations;
+#if defined(_WIN32)
+            in.read((char*)table, buckets * sizeof(HashBucket));
+            valid = bool(in);
+            if (!valid)
+                Clear(threads);
+#else
+            // the copy also first touches the new table from every thread
+            forEachSlice(threads, buckets, [this, data](unsigned long long first, unsigned long long count)
+            {
+                std::memcpy(table + first, data + first*sizeof(HashBucket), count*sizeof(HashBucket));
+            });
+#endif
+        }
+
+#if !defined(_WIN32)
+        munmap(mapping, size);
+#endif
+        return valid;
+    }
+
+    unsigned long long TranspositionTable::Size() const
+    {
+        return buckets * sizeof(HashBucket);
+    }
+
     //TODO return BEST pv move (exact score)
     Move TranspositionTable::GetPv(ZobristKey key)
     {
@@ -148,13 +408,70 @@ namespace Napoleon
 
         for (auto i=0; i<BucketSize; i++, hash++)
         {
-            if (hash->Hash == key)
+            HashEntry entry = *hash;
+
+            if (entry.Key() == key)
             {
-                if (!hash->BestMove.IsNull())
-                    return hash->BestMove;
+                if (!entry.BestMove().IsNull())
+                    return entry.BestMove();
             }
         }
 
         return Constants::NullMove;
     }
+
+    // abdada: one more thread searches the position. A position missing from the table gets
+    // an entry without a score, so that other threads also see the first visit of a node
+    void TranspositionTable::StartSearch(ZobristKey key, Byte age)
+    {
+        auto hash = slot(key, age);
+        HashEntry entry = *hash;
+        unsigned long long data;
+
+        if (entry.Key() == key)
+        {
+            Byte searching = entry.Searching() + (entry.Searching() < HashEntry::MaxSearching);
+            data = HashEntry::Pack(entry.Depth(), entry.Bound(), searching, entry.Score(), entry.Eval(), entry.BestMove());
+        }
+        else
+            data = HashEntry::Pack(0, (ScoreType::EvalOnly | (age << 2)), 1, 0, HashEntry::NoEval, Constants::NullMove);
+
+        hash->Data = data;
+        hash->Hash = key ^ data;
+    }
+
+    // a thread is done with the position. Like the rest of the table the count is updated
+    // without locks: an update lost to a concurrent one only changes which moves get deferred
+    void TranspositionTable::FinishSearch(ZobristKey key)
+    {
+        auto hash = at(key);
+
+        for (auto i=0; i<BucketSize; i++, hash++)
+        {
+            HashEntry entry = *hash;
+
+            if (entry.Key() == key && entry.Searching() > 0)
+            {
+                auto data = HashEntry::Pack(entry.Depth(), entry.Bound(), entry.Searching() - 1, entry.Score(), entry.Eval(), entry.BestMove());
+                hash->Data = data;
+                hash->Hash = key ^ data;
+                return;
+            }
+        }
+    }
+
+    bool TranspositionTable::IsSearching(ZobristKey key)
+    {
+        auto hash = at(key);
+
+        for (auto i=0; i<BucketSize; i++, hash++)
+        {
+            HashEntry entry = *hash;
+
+            if (entry.Key() == key)
+                return entry.Searching() > 0;
+        }
+
+        return false;
+    }
 }
@@ -2,12 +2,19 @@
 #define TRANSPOSITIONTABLE_H
 #include "defines.h"
 #include "hashentry.h"
-#include "spinlock.h"
-#include <mutex>
-#include <atomic>
+#include "utils.h"
+#include <string>
 
 namespace Napoleon
 {
+    // a bucket fills exactly one cache line so that a probe costs a single memory access
+    class alignas(64) HashBucket
+    {
+        public:
+            static const int Size = 4;
+            HashEntry entries[Size];
+    };
+
     class TranspositionTable
     {
         public:
@@ -17,25 +24,62 @@ namespace Napoleon
             TranspositionTable() = default;
             TranspositionTable(int size);
 
-            void SetSize(int);
-            void Save(ZobristKey, Byte, Byte, int, Move, ScoreType);
-            void Clear();
-            std::pair<int, Move> Probe(ZobristKey, Byte, Byte, int, int);
+            void SetSize(int, int = 1);
+            void Resize(int, Byte, int = 1);
+            bool Share(const std::string&, int);
+            void Save(ZobristKey, Byte, Byte, int, int, Move, ScoreType);
+            void Clear(int = 1);
+            std::pair<int, Move> Probe(ZobristKey, Byte, Byte, int, int, int&);
+            int ProbeEval(ZobristKey) const;
             Move GetPv(ZobristKey);
+            void StartSearch(ZobristKey, Byte);
+            void FinishSearch(ZobristKey);
+            bool IsSearching(ZobristKey);
+            void Prefetch(ZobristKey) const;
+            Utils::Memory::PageType Pages() const;
+            unsigned long long Size() const;
+            bool Dump(const std::string&, Byte) const;
+            bool Load(const std::string&, Byte&, int = 1);
 
-            bool Concurrent = false;
         private:
-            unsigned long long mask;
-            unsigned long entries;
-            unsigned long lock_entries;
-            HashEntry* table;
-            SpinLock* locks;
-            HashEntry* at(ZobristKey, int = 0) const;
+            static const int AgeWeight;
+
+            unsigned long long buckets = 0;
+            HashBucket* table = nullptr;
+            Utils::Memory::PageType pages = Utils::Memory::PageType::Small;
+            HashEntry* at(ZobristKey) const;
+            int value(const HashEntry&, Byte) const;
+            HashEntry* slot(ZobristKey, Byte) const;
+            void allocate(unsigned long long);
+            void release(HashBucket*, unsigned long long, Utils::Memory::PageType);
+            void insert(const HashEntry&, Byte);
+            template<typename Function>
+                void forEachSlice(int, unsigned long long, Function);
     };
 
-    inline HashEntry* TranspositionTable::at(ZobristKey key, int index) const
+    inline Utils::Memory::PageType TranspositionTable::Pages() const
+    {
+        return pages;
+    }
+
+    // first entry of the bucket holding the position
+    inline HashEntry* TranspositionTable::at(ZobristKey key) const
+    {
+        return table[Utils::Math::MulHi(key, buckets)].entries;
+    }
+
+    // start loading the bucket of a position that is going to be probed
+    inline void TranspositionTable::Prefetch(ZobristKey key) const
+    {
+        Utils::Memory::Prefetch(at(key));
+    }
+
+    // replacement value of an entry: deep entries are kept,
+    // but each search they survive without being probed costs AgeWeight plies
+    inline int TranspositionTable::value(const HashEntry& entry, Byte age) const
     {
-        return table + (key & mask) + index;
+        int distance = (HashEntry::Generations + age - (entry.Bound() >> 2)) % HashEntry::Generations;
+        return entry.Depth() - AgeWeight * distance;
     }
 
 }
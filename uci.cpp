@@ -19,6 +19,21 @@ namespace Napoleon
 
     Board Uci::board;
     thread Uci::search;
+    string hashFile = "napoleon.hash";
+    string sharedHash; // name of the shared memory block holding the table, empty if private
+
+    void loadHash(const string& file)
+    {
+        Byte age;
+        if (Search::Table.Load(file, age, Search::cores))
+        {
+            Search::Age = age;
+            sharedHash.clear(); // the loaded table is private
+            Uci::SendCommand<Command::Info>("string loaded " + to_string(Search::Table.Size() >> 20) + " MB hash table from " + file);
+        }
+        else
+            Uci::SendCommand<Command::Info>("string cannot load hash table from " + file);
+    }
 
     void Uci::Start()
     {
@@ -41,13 +56,21 @@ namespace Napoleon
                 SendCommand<Command::Generic>("id name Napoleon");
                 SendCommand<Command::Generic>("id author Marco Pampaloni");
                 SendCommand<Command::Generic>("option name Hash type spin default 1 min 1 max 131072"); // max 128 GB
-                SendCommand<Command::Generic>("option name Threads type spin default 1 min 1 max 8");
+                SendCommand<Command::Generic>("option name Threads type spin default 1 min 1 max 128");
+                SendCommand<Command::Generic>("option name ParallelSearch type combo default Lazy var Lazy var YBWC var ABDADA");
+                SendCommand<Command::Generic>("option name HashFile type string default " + hashFile);
+                SendCommand<Command::Generic>("option name LoadHashFile type check default false");
+                SendCommand<Command::Generic>("option name SharedHash type string default <empty>");
 
                 for (auto i=0; i<Search::Parameters::MAX; i++)
                 {
                     SendCommand<Command::Generic>("option name " + Search::param_name[i] + " type spin default 1 min 1 max 1024");
                 }
                 SendCommand<Command::Generic>("uciok");
+                // info strings are only allowed after the handshake
+                SendCommand<Command::Info>("string transposition table uses " + Utils::Memory::ToString(Search::Table.Pages())
+                                           + " (" + to_string(Search::Table.Size() >> 20) + " MB)");
+                SendCommand<Command::Info>("string pawn table uses " + Utils::Memory::ToString(Evaluation::pawnTable.Pages()));
             }
             else if (cmd == "setoption")
             {
@@ -59,7 +82,12 @@ namespace Napoleon
                 {
                     stream >> token; // "value"
                     stream >> token;
-                    Search::Table.SetSize(std::stoi(token));
+                    if (sharedHash.empty())
+                        Search::Table.Resize(std::stoi(token), Search::Age, Search::cores); // keeps the entries
+                    else
+                        Search::Table.Share(sharedHash, std::stoi(token)); // the size only applies to a new block
+                    SendCommand<Command::Info>("string transposition table uses " + Utils::Memory::ToString(Search::Table.Pages())
+                                               + " (" + to_string(Search::Table.Size() >> 20) + " MB)");
                 }
                 else if (token == "Threads") 
                 {
@@ -68,6 +96,57 @@ namespace Napoleon
                     stream >> parallel_threads;
                     Search::InitializeThreads(parallel_threads);
                 }
+                else if (token == "ParallelSearch")
+                {
+                    stream >> token; // "value"
+                    stream >> token;
+                    if (token == "YBWC")
+                        Search::parallelMode = ParallelMode::YBWC;
+                    else if (token == "ABDADA")
+                        Search::parallelMode = ParallelMode::ABDADA;
+                    else
+                        Search::parallelMode = ParallelMode::LazySMP;
+                }
+                else if (token == "HashFile")
+                {
+                    stream >> token; // "value"
+                    getline(stream >> ws, hashFile);
+                }
+                else if (token == "LoadHashFile") // restore the table saved by "savehash"
+                {
+                    stream >> token; // "value"
+                    stream >> token;
+                    if (token == "true")
+                        loadHash(hashFile);
+                }
+                else if (token == "SharedHash") // attach the table to a block shared with other processes
+                {
+                    stream >> token; // "value"
+                    if (!getline(stream >> ws, token) || token == "<empty>")
+                        token.clear();
+
+                    int mb = Search::Table.Size() >> 20;
+                    if (token.empty())
+                    {
+                        // detach from the shared block. A private table keeps its entries:
+                        // GUIs resend every option and would wipe a table just loaded
+                        if (!sharedHash.empty())
+                        {
+                            Search::Table.SetSize(mb, Search::cores);
+                            sharedHash.clear();
+                            SendCommand<Command::Info>("string transposition table uses " + Utils::Memory::ToString(Search::Table.Pages())
+                                                       + " (" + to_string(Search::Table.Size() >> 20) + " MB)");
+                        }
+                    }
+                    else if (Search::Table.Share(token, mb))
+                    {
+                        sharedHash = token;
+                        SendCommand<Command::Info>("string transposition table uses " + Utils::Memory::ToString(Search::Table.Pages())
+                                                   + " (" + to_string(Search::Table.Size() >> 20) + " MB)");
+                    }
+                    else
+                        SendCommand<Command::Info>("string cannot attach to shared hash table " + token);
+                }
                 else if (token == "PstPawnMg") // evaluation parameters
                 {
                     stream >> token; // "value"
@@ -108,9 +187,29 @@ namespace Napoleon
             {
                 SendCommand<Command::Generic>("readyok");
             }
+            else if (cmd == "savehash") // savehash [file]
+            {
+                string file;
+                if (!getline(stream >> ws, file))
+                    file = hashFile;
+
+                if (Search::Table.Dump(file, Search::Age))
+                    SendCommand<Command::Info>("string saved hash table to " + file);
+                else
+                    SendCommand<Command::Info>("string cannot save hash table to " + file);
+            }
+            else if (cmd == "loadhash") // loadhash [file]
+            {
+                string file;
+                if (!getline(stream >> ws, file))
+                    file = hashFile;
+
+                loadHash(file);
+            }
             else if (cmd == "ucinewgame")
             {
-                Search::Table.Clear();
+                if (sharedHash.empty()) // other processes may still be using a shared table
+                    Search::Table.Clear(Search::cores);
             }
             else if (cmd == "stop")
             {
@@ -169,8 +268,9 @@ namespace Napoleon
             }
             else if (cmd == "eval")
             {
+                EvalContext context;
                 Evaluation::PrintEval(board);
-                std::cout << Evaluation::Evaluate(board) << std::endl;
+                std::cout << Evaluation::Evaluate(board, context) << std::endl;
             }
             else if (cmd == "go")
             {
@@ -5,6 +5,15 @@
 #include <algorithm>
 #include <iostream>
 #include <cassert>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 namespace Napoleon
 {
@@ -182,6 +191,174 @@ namespace Napoleon
             }
         }
 
+        namespace Memory
+        {
+#if defined(_WIN32)
+            void* AllocateLarge(std::size_t size, PageType& type)
+            {
+                // large pages need the "lock pages in memory" privilege, so only small pages are requested
+                type = PageType::Small;
+                return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            }
+
+            void FreeLarge(void* memory, std::size_t)
+            {
+                if (memory != nullptr)
+                    VirtualFree(memory, 0, MEM_RELEASE);
+            }
+
+            // size is set to the size of the mapping, which is the requested one only if the block is created here
+            void* AttachShared(const std::string& name, std::size_t& size)
+            {
+                HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                                    DWORD((unsigned long long)size >> 32), DWORD(size), ("Local\\" + name).c_str());
+                if (mapping == nullptr)
+                    return nullptr;
+
+                void* memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+                CloseHandle(mapping); // the view keeps the block alive
+
+                MEMORY_BASIC_INFORMATION info;
+                if (memory != nullptr && VirtualQuery(memory, &info, sizeof(info)) != 0)
+                    size = info.RegionSize;
+
+                return memory;
+            }
+
+            void DetachShared(void* memory, std::size_t)
+            {
+                if (memory != nullptr)
+                    UnmapViewOfFile(memory);
+            }
+#else
+            const std::size_t HugePageSize = 2 * 1024 * 1024;
+            const std::size_t GiganticPageSize = 1024 * 1024 * 1024;
+
+            std::size_t roundSize(std::size_t size)
+            {
+                return (size + HugePageSize - 1) & ~(HugePageSize - 1);
+            }
+
+            void* map(std::size_t size, int flags)
+            {
+                void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+                return memory == MAP_FAILED ? nullptr : memory;
+            }
+
+            // tries 1 GB pages, then 2 MB pages, then small pages (transparent huge pages where available)
+            void* AllocateLarge(std::size_t size, PageType& type)
+            {
+                size = roundSize(size);
+                void* memory;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+                // explicit 1 GB pages (reserved through /sys/kernel/mm/hugepages), only for
+                // whole pages so that no memory is wasted and FreeLarge unmaps the same size
+                if (size % GiganticPageSize == 0 && (memory = map(size, MAP_HUGETLB | (30 << MAP_HUGE_SHIFT))) != nullptr)
+                {
+                    type = PageType::Gigantic;
+                    return memory;
+                }
+#endif
+
+#if defined(MAP_HUGETLB)
+                // explicit 2 MB pages (they must be reserved through /proc/sys/vm/nr_hugepages)
+                if ((memory = map(size, MAP_HUGETLB)) != nullptr)
+                {
+                    type = PageType::Huge;
+                    return memory;
+                }
+#endif
+
+                type = PageType::Small;
+
+#if defined(MADV_HUGEPAGE)
+                // transparent huge pages: the kernel can only back 2 MB aligned ranges,
+                // so map one more huge page and trim the misaligned head and tail
+                char* raw = (char*) map(size + HugePageSize, 0);
+                if (raw != nullptr)
+                {
+                    char* aligned = (char*) roundSize((std::size_t)raw);
+                    if (aligned > raw)
+                        munmap(raw, aligned - raw);
+                    munmap(aligned + size, raw + HugePageSize - aligned);
+
+                    if (madvise(aligned, size, MADV_HUGEPAGE) == 0)
+                        type = PageType::Transparent;
+
+                    return aligned;
+                }
+#endif
+
+                return map(size, 0); // nullptr if even small pages are not available
+            }
+
+            void FreeLarge(void* memory, std::size_t size)
+            {
+                if (memory != nullptr)
+                    munmap(memory, roundSize(size));
+            }
+
+            // size is set to the size of the block, which is the requested one only if the block is created here.
+            // The block outlives the processes using it until it is removed from /dev/shm
+            void* AttachShared(const std::string& name, std::size_t& size)
+            {
+                std::string path = "/" + name;
+                int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+                if (fd >= 0)
+                {
+                    if (ftruncate(fd, size) != 0) // the new block is zero filled
+                    {
+                        close(fd);
+                        shm_unlink(path.c_str());
+                        return nullptr;
+                    }
+                }
+                else
+                {
+                    fd = shm_open(path.c_str(), O_RDWR, 0600);
+                    struct stat info;
+                    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0)
+                    {
+                        if (fd >= 0)
+                            close(fd);
+                        return nullptr;
+                    }
+                    size = info.st_size;
+                }
+
+                void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd); // the mapping keeps the block alive
+
+                return memory == MAP_FAILED ? nullptr : memory;
+            }
+
+            void DetachShared(void* memory, std::size_t size)
+            {
+                if (memory != nullptr)
+                    munmap(memory, size);
+            }
+#endif
+
+            std::string ToString(PageType type)
+            {
+                switch (type)
+                {
+                case PageType::Gigantic:
+                    return "1 GB huge pages";
+                case PageType::Huge:
+                    return "2 MB huge pages";
+                case PageType::Transparent:
+                    return "transparent huge pages";
+                case PageType::Shared:
+                    return "shared memory";
+                default:
+                    return "small pages";
+                }
+            }
+        }
+
         namespace String
         {
 
@@ -52,6 +52,22 @@ namespace Napoleon
         {
             // visual studio does not provide log2 function
             double Log2(double);
+            unsigned long long MulHi(unsigned long long, unsigned long long);
+        }
+
+        namespace Memory
+        {
+            enum class PageType { Small, Transparent, Huge, Gigantic, Shared };
+
+            // page aligned, zero filled block for big tables, backed by huge pages when the os allows it.
+            // Returns nullptr if the block cannot be allocated
+            void* AllocateLarge(std::size_t, PageType&);
+            void FreeLarge(void*, std::size_t);
+            // named block mapped by every process that attaches to it, created zero filled if missing
+            void* AttachShared(const std::string&, std::size_t&);
+            void DetachShared(void*, std::size_t);
+            std::string ToString(PageType);
+            void Prefetch(const void*);
         }
 
         namespace String
@@ -141,6 +157,33 @@ namespace Napoleon
 #endif
         }
 
+        // high 64 bits of the 128 bit product: maps a uniform key to [0, n) for any n
+        INLINE unsigned long long Math::MulHi(unsigned long long a, unsigned long long b)
+        {
+#if defined(__GNUC__) && defined(__SIZEOF_INT128__)
+            return ((unsigned __int128)a * b) >> 64;
+#elif defined(_MSC_VER) && defined(_WIN64)
+            return __umulh(a, b);
+#else
+            unsigned long long aLo = a & 0xffffffff, aHi = a >> 32;
+            unsigned long long bLo = b & 0xffffffff, bHi = b >> 32;
+            unsigned long long mid = (aLo * bLo >> 32) + (aHi * bLo & 0xffffffff) + aLo * bHi;
+            return aHi * bHi + (aHi * bLo >> 32) + (mid >> 32);
+#endif
+        }
+
+        // hint the cpu to start loading the cache line holding the address
+        INLINE void Memory::Prefetch(const void* address)
+        {
+#if defined(__GNUC__)
+            __builtin_prefetch(address);
+#elif defined(_MSC_VER)
+            _mm_prefetch((const char*)address, _MM_HINT_T0);
+#else
+            (void)address;
+#endif
+        }
+
         INLINE Napoleon::BitBoard BitBoard::SouthFill(Napoleon::BitBoard bitboard)
         {
             bitboard |= bitboard >> 8;